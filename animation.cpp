@@ -0,0 +1,101 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "animation.h"
+#include <algorithm>
+
+using namespace std;
+
+// after a stall, e.g. a long icon collect, skip ahead instead of replaying every step
+#define MAXCATCHUPSTEPS 4
+
+
+AnimationScheduler::AnimationScheduler( int step ) :
+    m_last_step(0),
+    m_step(step)
+{
+}
+
+void AnimationScheduler::start( Animation* animation )
+{
+    if (find(m_animations.begin(),m_animations.end(),animation)!=m_animations.end()) {
+        return;
+    }
+    if (m_animations.empty()) {
+        // the first step is one interval after the animation started
+        m_last_step = SDL_GetTicks();
+    }
+    m_animations.push_back(animation);
+}
+
+void AnimationScheduler::stop( Animation* animation )
+{
+    m_animations.erase(remove(m_animations.begin(),m_animations.end(),animation),m_animations.end());
+}
+
+bool AnimationScheduler::is_active() const
+{
+    return !m_animations.empty();
+}
+
+int AnimationScheduler::update( Uint32 now )
+{
+    if (m_animations.empty()) {
+        return 0;
+    }
+    int steps = (now-m_last_step)/m_step;
+    if (steps>MAXCATCHUPSTEPS) {
+        m_last_step = now-MAXCATCHUPSTEPS*m_step;
+        steps = MAXCATCHUPSTEPS;
+    }
+    for (int s=0; s<steps && !m_animations.empty(); s++) {
+        m_last_step += m_step;
+        for (size_t i=0; i<m_animations.size(); ) {
+            if (m_animations[i]->step(m_step)) {
+                i++;
+            } else {
+                m_animations.erase(m_animations.begin()+i);
+            }
+        }
+    }
+    return steps;
+}
+
+Uint32 AnimationScheduler::get_time_to_next_step( Uint32 now ) const
+{
+    Uint32 due = m_last_step+m_step;
+    return int(due-now)>0 ? due-now : 0;
+}
+
+float ease_out( float t )
+{
+    if (t>=1) return 1;
+    float r = 1-t;
+    return 1-r*r*r;
+}
@@ -0,0 +1,76 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <SDL.h>
+#include <vector>
+
+
+/// something that changes over time, advanced in fixed steps by AnimationScheduler
+class Animation
+{
+public:
+    virtual ~Animation() {}
+
+    /// advance by dt milliseconds, returns false once settled
+    virtual bool step( int dt ) = 0;
+};
+
+/// advances the running animations with a fixed timestep. while one is running the main loop
+/// polls and paces its frames, once all settled it can go back to blocking in SDL_WaitEvent
+class AnimationScheduler
+{
+public:
+    /// step: timestep in milliseconds, usually one display refresh
+    AnimationScheduler( int step );
+
+    /// animations are not owned, starting a running one again is harmless
+    void start( Animation* animation );
+    void stop( Animation* animation );
+
+    bool is_active() const;
+
+    /// runs every step due until now, returns the number of steps taken
+    int update( Uint32 now );
+
+    /// milliseconds until the next step is due
+    Uint32 get_time_to_next_step( Uint32 now ) const;
+
+private:
+    std::vector<Animation*> m_animations;
+    Uint32 m_last_step;
+    int m_step;
+};
+
+/// ease out cubic, t in 0..1
+float ease_out( float t );
+
+#endif
@@ -0,0 +1,167 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "apkhandlepool.h"
+#include "profiler.h"
+
+using namespace std;
+
+
+ApkHandlePool::ApkHandlePool( int capacity ) :
+    m_capacity(capacity),
+    m_hits(0),
+    m_misses(0),
+    m_open(0),
+    m_peak_open(0)
+{
+    m_mutex = SDL_CreateMutex();
+}
+
+ApkHandlePool::~ApkHandlePool()
+{
+    for (list<Handle>::iterator it=m_handles.begin(); it!=m_handles.end(); ++it) {
+        close_handle(it->apk);
+    }
+    SDL_DestroyMutex(m_mutex);
+}
+
+AndroidApk* ApkHandlePool::acquire( const string& path )
+{
+    SDL_LockMutex(m_mutex);
+    for (list<Handle>::iterator it=m_handles.begin(); it!=m_handles.end(); ++it) {
+        if (!it->busy && !it->stale && it->path==path) {
+            Handle h = *it;
+            h.busy = true;
+            m_handles.erase(it);
+            m_handles.push_front(h);
+            m_hits ++;
+            SDL_UnlockMutex(m_mutex);
+            return h.apk;
+        }
+    }
+    m_misses ++;
+    SDL_UnlockMutex(m_mutex);
+
+    // open outside the lock, parsing the zip directory takes a while
+    AndroidApk* apk;
+    {
+        ProfileScope profile("apk_open",false,&path);
+        apk = apk_open(path.c_str());
+    }
+    if (apk==NULL) {
+        return NULL;
+    }
+
+    SDL_LockMutex(m_mutex);
+    Handle h = {path,apk,true,false};
+    m_handles.push_front(h);
+    m_open ++;
+    if (m_open>m_peak_open) {
+        m_peak_open = m_open;
+    }
+    SDL_UnlockMutex(m_mutex);
+    return apk;
+}
+
+void ApkHandlePool::release( AndroidApk* apk )
+{
+    if (apk==NULL) {
+        return;
+    }
+    SDL_LockMutex(m_mutex);
+    for (list<Handle>::iterator it=m_handles.begin(); it!=m_handles.end(); ++it) {
+        if (it->apk==apk) {
+            it->busy = false;
+            if (it->stale) {
+                close_handle(it->apk);
+                m_handles.erase(it);
+            }
+            break;
+        }
+    }
+    trim();
+    SDL_UnlockMutex(m_mutex);
+}
+
+void ApkHandlePool::flush()
+{
+    SDL_LockMutex(m_mutex);
+    int capacity = m_capacity;
+    m_capacity = 0;
+    trim();
+    m_capacity = capacity;
+    SDL_UnlockMutex(m_mutex);
+}
+
+void ApkHandlePool::forget( const string& path )
+{
+    SDL_LockMutex(m_mutex);
+    for (list<Handle>::iterator it=m_handles.begin(); it!=m_handles.end(); ) {
+        if (it->path!=path) {
+            ++it;
+        } else if (it->busy) {
+            it->stale = true;
+            ++it;
+        } else {
+            close_handle(it->apk);
+            it = m_handles.erase(it);
+        }
+    }
+    SDL_UnlockMutex(m_mutex);
+}
+
+void ApkHandlePool::print_stats( ostream& out ) const
+{
+    int lookups = m_hits+m_misses;
+    out << "apk handles: " << m_hits << " hits, " << m_misses << " misses";
+    if (lookups>0) {
+        out << " (" << (m_hits*100/lookups) << "% hit rate)";
+    }
+    out << ", " << m_open << " open, " << m_peak_open << " peak" << endl;
+}
+
+void ApkHandlePool::close_handle( AndroidApk* apk )
+{
+    apk_close(apk);
+    m_open --;
+}
+
+void ApkHandlePool::trim()
+{
+    // drop idle handles from the least recently used end
+    int idle = 0;
+    for (list<Handle>::iterator it=m_handles.begin(); it!=m_handles.end(); ) {
+        if (!it->busy && ++idle>m_capacity) {
+            close_handle(it->apk);
+            it = m_handles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,92 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef APKHANDLEPOOL_H
+#define APKHANDLEPOOL_H
+
+#include <SDL.h>
+#include <string>
+#include <list>
+#include <iostream>
+
+extern "C"
+{
+#include "../apkenv/apklib/apklib.h"
+}
+
+
+/// keeps a few recently used apk handles open, everything else is closed right after use
+/// so a large library does not pin one descriptor and zip directory per apk
+class ApkHandlePool
+{
+public:
+    ApkHandlePool( int capacity );
+    virtual ~ApkHandlePool();
+
+    /// returns an open handle for path or NULL, must be handed back with release().
+    /// a handle is never shared between two callers at the same time
+    AndroidApk* acquire( const std::string& path );
+    void release( AndroidApk* apk );
+
+    /// closes every idle handle
+    void flush();
+
+    /// drops the handles for path, e.g. after the file was replaced or deleted.
+    /// busy ones are closed on release instead of going back to the pool
+    void forget( const std::string& path );
+
+    int get_hits() const { return m_hits; }
+    int get_misses() const { return m_misses; }
+    int get_peak_open() const { return m_peak_open; }
+
+    void print_stats( std::ostream& out ) const;
+
+protected:
+    void close_handle( AndroidApk* apk );
+    void trim();
+
+private:
+    struct Handle
+    {
+        std::string path;
+        AndroidApk* apk;
+        bool busy;
+        bool stale;
+    };
+
+    std::list<Handle> m_handles;   // most recently used first
+    SDL_mutex* m_mutex;
+    int m_capacity;
+    int m_hits;
+    int m_misses;
+    int m_open;
+    int m_peak_open;
+};
+
+#endif
@@ -0,0 +1,137 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "apklauncher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <iostream>
+
+using namespace std;
+
+// see http://pandorawiki.org/Kernel_interface
+#define NUBCHANGESCRIPT "/usr/pandora/scripts/op_nubchange.sh"
+#define NUB0MODE        "/proc/pandora/nub0/mode"
+#define NUB1MODE        "/proc/pandora/nub1/mode"
+
+
+/// forks and execs argv, stdout and stderr go to logfile if given. returns the exit status or -1
+static int run( const char* const* argv, const char* logfile )
+{
+    pid_t pid = fork();
+    if (pid<0) {
+        cerr << "Failed to fork: " << strerror(errno) << endl;
+        return -1;
+    }
+    if (pid==0) {
+        if (logfile) {
+            int log = open(logfile,O_WRONLY|O_CREAT|O_TRUNC,0644);
+            if (log>=0) {
+                dup2(log,1);
+                dup2(log,2);
+                close(log);
+            }
+        }
+        execv(argv[0],(char* const*)argv);
+        _exit(127);
+    }
+
+    int status = 0;
+    while (waitpid(pid,&status,0)<0) {
+        if (errno!=EINTR) return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static string read_mode( const char* file )
+{
+    char buf[64] = {0};
+    FILE* fp = fopen(file,"r");
+    if (fp) {
+        if (fgets(buf,sizeof(buf),fp)==NULL) buf[0] = 0;
+        fclose(fp);
+    }
+    string mode = buf;
+    while (mode.size() && (mode[mode.size()-1]=='\n' || mode[mode.size()-1]==' ')) {
+        mode.erase(mode.size()-1);
+    }
+    return mode;
+}
+
+static void write_mode( const char* file, const string& mode )
+{
+    FILE* fp = fopen(file,"w");
+    if (fp) {
+        fprintf(fp,"%s\n",mode.c_str());
+        fclose(fp);
+    }
+}
+
+/// the system script also updates the nub daemon's state, the proc files are the fallback
+static void set_nub_modes( const string& nub0, const string& nub1 )
+{
+    if (nub0.empty() || nub1.empty()) {
+        return;
+    }
+    if (access(NUBCHANGESCRIPT,X_OK)==0) {
+        const char* argv[] = { NUBCHANGESCRIPT, nub0.c_str(), nub1.c_str(), NULL };
+        run(argv,NULL);
+    } else {
+        write_mode(NUB0MODE,nub0);
+        write_mode(NUB1MODE,nub1);
+    }
+}
+
+int launch_apk( const string& apkenv, const string& apk, const string& logfile )
+{
+    // empty off the pandora, nothing to switch then
+    string nub0 = read_mode(NUB0MODE);
+    string nub1 = read_mode(NUB1MODE);
+    set_nub_modes(nub0.empty() ? "" : "absolute",nub1.empty() ? "" : "absolute");
+
+    // see http://pandorawiki.org/SDL#Cursor_drift_in_fullscreen_mode
+    const char* relative = getenv("SDL_MOUSE_RELATIVE");
+    string oldrelative = relative ? relative : "";
+    setenv("SDL_MOUSE_RELATIVE","0",1);
+
+    const char* argv[] = { apkenv.c_str(), apk.c_str(), NULL };
+    int status = run(argv,logfile.c_str());
+
+    if (relative)
+        setenv("SDL_MOUSE_RELATIVE",oldrelative.c_str(),1);
+    else
+        unsetenv("SDL_MOUSE_RELATIVE");
+
+    set_nub_modes(nub0,nub1);
+    return status;
+}
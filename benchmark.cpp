@@ -0,0 +1,460 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+/** headless benchmark for the launcher **/
+
+// generates synthetic apk corpora and runs the launcher on them with SDL's dummy video
+// driver, --profile and --bench-keys. every corpus is measured cold (no icon cache, no
+// index) and warm, the median over several runs is reported and can be compared against
+// a stored baseline. runs on any linux box, no display needed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "synthapk.h"
+#include "scalerbench.h"
+#include "blendbench.h"
+
+using namespace std;
+
+#define DEFAULTSIZES    "10,100,1000,10000"
+#define DEFAULTRUNS     5
+#define DEFAULTKEYS     40
+#define DEFAULTTOLERANCE 15
+#define SCALERITERATIONS 1000
+#define BLENDITERATIONS  1000
+#define RUNTIMEOUT      600
+#define CORPUSMARKER    "corpus.ok"
+#define PROFILEFILE     "profile.json"
+#define LOGFILE         "launcher.log"
+
+
+struct Options
+{
+    string launcher;
+    string resources;
+    string workdir;
+    vector<int> sizes;
+    int runs;
+    int keys;
+    int scan_threads;
+    string output;
+    string baseline;
+    int tolerance;
+    bool scaler;
+    bool blend;
+};
+
+/// one launcher run, times in microseconds
+struct Sample
+{
+    double first_frame;
+    double icons_ready;
+    double list_apks;
+    double keypress;
+    double peak_rss_kb;
+};
+
+typedef map<string,double> Results;   // "size mode metric" -> median
+
+
+string absolute_path( const string& path )
+{
+    char buf[PATH_MAX];
+    if (realpath(path.c_str(),buf)==NULL) {
+        return "";
+    }
+    return buf;
+}
+
+void make_dirs( const string& path )
+{
+    for (size_t i=1; i<=path.size(); i++) {
+        if (i==path.size() || path[i]=='/') {
+            mkdir(path.substr(0,i).c_str(),0755);
+        }
+    }
+}
+
+/// creates size apks under dir/apks unless a complete corpus of that size is already there
+bool ensure_corpus( const string& dir, int size )
+{
+    string marker = dir+"/" CORPUSMARKER;
+    int existing = 0;
+    FILE* fp = fopen(marker.c_str(),"r");
+    if (fp) {
+        if (fscanf(fp,"%d",&existing)!=1) existing = 0;
+        fclose(fp);
+    }
+    if (existing==size) {
+        return true;
+    }
+
+    cout << "Generating " << size << " apks in " << dir << endl;
+    make_dirs(dir+"/apks");
+    for (int i=0; i<size; i++) {
+        char name[64], label[64];
+        sprintf(name,"synth_%05d.apk",i);
+        sprintf(label,"Synthetic App %05d",i);
+        if (!write_synthetic_apk(dir+"/apks/"+name,label,i+1)) {
+            cerr << "Failed to write " << dir << "/apks/" << name << endl;
+            return false;
+        }
+    }
+
+    fp = fopen(marker.c_str(),"w");
+    if (!fp) {
+        return false;
+    }
+    fprintf(fp,"%d\n",size);
+    fclose(fp);
+    return true;
+}
+
+/// a cold start finds neither icon cache nor index nor config
+void clear_caches( const string& dir )
+{
+    string cache = dir+"/iconcache";
+    DIR* d = opendir(cache.c_str());
+    if (d) {
+        struct dirent* entry;
+        while ((entry=readdir(d))!=0) {
+            if (entry->d_name[0]!='.') {
+                unlink((cache+"/"+entry->d_name).c_str());
+            }
+        }
+        closedir(d);
+    }
+    unlink((dir+"/apkenvui.idx").c_str());
+    unlink((dir+"/apkenvui.cfg").c_str());
+}
+
+/// the value following key in the profile, -1 if missing
+double profile_value( const string& json, const string& key, const char* field )
+{
+    size_t pos = json.find(key);
+    if (pos==string::npos) {
+        return -1;
+    }
+    pos = json.find(string("\"")+field+"\": ",pos);
+    if (pos==string::npos) {
+        return -1;
+    }
+    return atof(json.c_str()+pos+strlen(field)+4);
+}
+
+bool run_launcher( const Options& options, const string& dir, Sample* sample )
+{
+    string profile = dir+"/" PROFILEFILE;
+    unlink(profile.c_str());
+
+    char keys[32], threads[32];
+    sprintf(keys,"--bench-keys=%d",options.keys);
+    sprintf(threads,"--scan-threads=%d",options.scan_threads);
+    string profilearg = "--profile="+profile;
+
+    pid_t pid = fork();
+    if (pid<0) {
+        cerr << "Failed to fork" << endl;
+        return false;
+    }
+    if (pid==0) {
+        if (chdir(dir.c_str())!=0) _exit(127);
+        setenv("SDL_VIDEODRIVER","dummy",1);
+        setenv("SDL_AUDIODRIVER","dummy",1);
+        int log = open(LOGFILE,O_WRONLY|O_CREAT|O_TRUNC,0644);
+        if (log>=0) {
+            dup2(log,1);
+            dup2(log,2);
+            close(log);
+        }
+        execl(options.launcher.c_str(),options.launcher.c_str(),profilearg.c_str(),keys,
+              options.scan_threads>0 ? threads : (char*)NULL,(char*)NULL);
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    memset(&usage,0,sizeof(usage));
+    for (int waited=0; ; waited++) {
+        pid_t r = wait4(pid,&status,WNOHANG,&usage);
+        if (r==pid) break;
+        if (r<0 || waited>RUNTIMEOUT*100) {
+            cerr << "Launcher did not finish, see " << dir << "/" LOGFILE << endl;
+            kill(pid,SIGKILL);
+            waitpid(pid,NULL,0);
+            return false;
+        }
+        usleep(10000);
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status)!=0) {
+        cerr << "Launcher failed, see " << dir << "/" LOGFILE << endl;
+        return false;
+    }
+
+    ifstream in(profile.c_str());
+    stringstream json;
+    json << in.rdbuf();
+    string text = json.str();
+
+    double firststart = profile_value(text,"\"first_frame\"","start");
+    sample->first_frame = firststart + profile_value(text,"\"first_frame\"","duration");
+    sample->icons_ready = profile_value(text,"\"icons_ready\"","start") + profile_value(text,"\"icons_ready\"","duration");
+    sample->list_apks = profile_value(text,"\"list_apks\"","duration");
+    double keytime = profile_value(text,"\"keypress_redraw\"","duration");
+    double keycount = profile_value(text,"\"keypress_redraw\"","calls");
+    sample->keypress = keycount>0 ? keytime/keycount : -1;
+    sample->peak_rss_kb = usage.ru_maxrss;
+
+    if (firststart<0) {
+        cerr << "No profile from launcher, see " << dir << "/" LOGFILE << endl;
+        return false;
+    }
+    return true;
+}
+
+double median( vector<double> values )
+{
+    if (values.empty()) return -1;
+    sort(values.begin(),values.end());
+    size_t n = values.size();
+    return n%2 ? values[n/2] : (values[n/2-1]+values[n/2])/2;
+}
+
+void add_results( Results* results, int size, const char* mode, const vector<Sample>& samples )
+{
+    static const char* names[] = { "first_frame_us", "icons_ready_us", "list_apks_us", "keypress_us", "peak_rss_kb" };
+    for (int m=0; m<5; m++) {
+        vector<double> values;
+        for (size_t i=0; i<samples.size(); i++) {
+            const Sample& s = samples[i];
+            double fields[] = { s.first_frame, s.icons_ready, s.list_apks, s.keypress, s.peak_rss_kb };
+            values.push_back(fields[m]);
+        }
+        ostringstream key;
+        key << size << " " << mode << " " << names[m];
+        (*results)[key.str()] = median(values);
+    }
+}
+
+bool measure( const Options& options, int size, Results* results )
+{
+    ostringstream dirname;
+    dirname << options.workdir << "/corpus-" << size;
+    string dir = dirname.str();
+    if (!ensure_corpus(dir,size)) {
+        return false;
+    }
+    string res = dir+"/res";
+    unlink(res.c_str());
+    if (symlink(options.resources.c_str(),res.c_str())!=0) {
+        cerr << "Failed to link " << res << endl;
+        return false;
+    }
+
+    vector<Sample> cold, warm;
+    for (int r=0; r<options.runs; r++) {
+        Sample sample;
+        clear_caches(dir);
+        if (!run_launcher(options,dir,&sample)) return false;
+        cold.push_back(sample);
+    }
+    // the last cold run left a complete cache behind
+    for (int r=0; r<options.runs; r++) {
+        Sample sample;
+        if (!run_launcher(options,dir,&sample)) return false;
+        warm.push_back(sample);
+    }
+    add_results(results,size,"cold",cold);
+    add_results(results,size,"warm",warm);
+    return true;
+}
+
+bool load_results( const string& filename, Results* results )
+{
+    ifstream in(filename.c_str());
+    if (!in) {
+        return false;
+    }
+    string size, mode, metric;
+    double value;
+    while (in >> size >> mode >> metric >> value) {
+        (*results)[size+" "+mode+" "+metric] = value;
+    }
+    return true;
+}
+
+bool save_results( const string& filename, const Results& results )
+{
+    ofstream out(filename.c_str());
+    for (Results::const_iterator it=results.begin(); it!=results.end(); ++it) {
+        out << it->first << " " << (long long)it->second << endl;
+    }
+    return bool(out);
+}
+
+/// prints every metric next to the baseline, returns the number of regressions beyond tolerance
+int compare_results( const Results& results, const Results& baseline, int tolerance )
+{
+    int regressions = 0;
+    for (Results::const_iterator it=results.begin(); it!=results.end(); ++it) {
+        cout << it->first << " " << (long long)it->second;
+        Results::const_iterator base = baseline.find(it->first);
+        if (base!=baseline.end() && base->second>0 && it->second>=0) {
+            double change = (it->second-base->second)*100/base->second;
+            char buf[64];
+            sprintf(buf," (%+.1f%%)",change);
+            cout << buf;
+            if (change>tolerance) {
+                cout << " REGRESSION";
+                regressions ++;
+            }
+        }
+        cout << endl;
+    }
+    return regressions;
+}
+
+vector<int> parse_sizes( const char* list )
+{
+    vector<int> sizes;
+    for (const char* p=list; *p; ) {
+        int size = atoi(p);
+        if (size>0) sizes.push_back(size);
+        p = strchr(p,',');
+        if (!p) break;
+        p++;
+    }
+    return sizes;
+}
+
+void usage( const char* name )
+{
+    cerr << "usage: " << name << " [options]" << endl
+         << "    --launcher=PATH    launcher binary (default: ./apkenvui)" << endl
+         << "    --res=DIR          launcher resources (default: ./res)" << endl
+         << "    --workdir=DIR      corpora and caches go here (default: ./bench)" << endl
+         << "    --sizes=N,N,...    corpus sizes (default: " DEFAULTSIZES ")" << endl
+         << "    --runs=N           runs per size and mode, the median is reported (default: " << DEFAULTRUNS << ")" << endl
+         << "    --keys=N           synthetic key presses per run (default: " << DEFAULTKEYS << ")" << endl
+         << "    --scan-threads=N   passed on to the launcher" << endl
+         << "    --output=FILE      store the results, e.g. as a new baseline" << endl
+         << "    --baseline=FILE    compare against stored results" << endl
+         << "    --tolerance=PCT    slowdown that counts as regression (default: " << DEFAULTTOLERANCE << ")" << endl
+         << "    --scaler           only time and check the icon scaler, no launcher runs" << endl
+         << "    --blend            only time and check the 565 alpha blend, no launcher runs" << endl;
+}
+
+int main( int argc, char** argv )
+{
+    Options options;
+    options.launcher = "./apkenvui";
+    options.resources = "./res";
+    options.workdir = "./bench";
+    options.sizes = parse_sizes(DEFAULTSIZES);
+    options.runs = DEFAULTRUNS;
+    options.keys = DEFAULTKEYS;
+    options.scan_threads = 0;
+    options.tolerance = DEFAULTTOLERANCE;
+    options.scaler = false;
+    options.blend = false;
+
+    for (int i=1; i<argc; i++) {
+        const char* arg = argv[i];
+        if (strncmp(arg,"--launcher=",11)==0) options.launcher = arg+11;
+        else if (strncmp(arg,"--res=",6)==0) options.resources = arg+6;
+        else if (strncmp(arg,"--workdir=",10)==0) options.workdir = arg+10;
+        else if (strncmp(arg,"--sizes=",8)==0) options.sizes = parse_sizes(arg+8);
+        else if (strncmp(arg,"--runs=",7)==0) options.runs = atoi(arg+7);
+        else if (strncmp(arg,"--keys=",7)==0) options.keys = atoi(arg+7);
+        else if (strncmp(arg,"--scan-threads=",15)==0) options.scan_threads = atoi(arg+15);
+        else if (strncmp(arg,"--output=",9)==0) options.output = arg+9;
+        else if (strncmp(arg,"--baseline=",11)==0) options.baseline = arg+11;
+        else if (strncmp(arg,"--tolerance=",12)==0) options.tolerance = atoi(arg+12);
+        else if (strcmp(arg,"--scaler")==0) options.scaler = true;
+        else if (strcmp(arg,"--blend")==0) options.blend = true;
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (options.scaler) {
+        return run_scaler_benchmark(SCALERITERATIONS);
+    }
+    if (options.blend) {
+        return run_blend_benchmark(BLENDITERATIONS);
+    }
+
+    make_dirs(options.workdir);
+    options.launcher = absolute_path(options.launcher);
+    options.resources = absolute_path(options.resources);
+    options.workdir = absolute_path(options.workdir);
+    if (options.launcher.empty() || options.resources.empty() || options.workdir.empty()
+        || options.sizes.empty() || options.runs<1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    Results results;
+    for (size_t i=0; i<options.sizes.size(); i++) {
+        if (!measure(options,options.sizes[i],&results)) {
+            return 1;
+        }
+    }
+
+    Results baseline;
+    if (options.baseline.size() && !load_results(options.baseline,&baseline)) {
+        cerr << "Failed to read baseline " << options.baseline << endl;
+    }
+    int regressions = compare_results(results,baseline,options.tolerance);
+
+    if (options.output.size() && !save_results(options.output,results)) {
+        cerr << "Failed to write " << options.output << endl;
+        return 1;
+    }
+    return regressions ? 1 : 0;
+}
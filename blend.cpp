@@ -0,0 +1,267 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "blend.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BLEND_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define BLEND_SSE2
+#endif
+
+
+// (s-d)*a>>8 + d == (s*a + d*(256-a))>>8 for integer d, the right hand side
+// stays positive and fits into 16 bits, which the vector versions rely on.
+// it never reaches s for a==255, so opaque pixels are copied and clear ones skipped.
+
+void blend_span_565_scalar( const Uint32* src, Uint16* dst, int w, int rshift, int gshift, int bshift, int ashift )
+{
+    for (int i=0; i<w; i++) {
+        Uint32 s = src[i];
+        Uint32 a = (s>>ashift)&0xff;
+        if (a==0) continue;
+        if (a==255) {
+            dst[i] = Uint16(((((s>>rshift)&0xff)>>3)<<11) | ((((s>>gshift)&0xff)>>2)<<5) | (((s>>bshift)&0xff)>>3));
+            continue;
+        }
+
+        Uint32 d = dst[i];
+        Uint32 dr = ((d&0xf800)>>11)<<3;
+        Uint32 dg = ((d&0x07e0)>>5)<<2;
+        Uint32 db = (d&0x001f)<<3;
+        Uint32 ia = 256-a;
+
+        Uint32 r = (((s>>rshift)&0xff)*a + dr*ia)>>8;
+        Uint32 g = (((s>>gshift)&0xff)*a + dg*ia)>>8;
+        Uint32 b = (((s>>bshift)&0xff)*a + db*ia)>>8;
+
+        dst[i] = Uint16(((r>>3)<<11) | ((g>>2)<<5) | (b>>3));
+    }
+}
+
+#if defined(BLEND_SSE2)
+
+static inline __m128i channel16( __m128i lo, __m128i hi, int shift )
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    __m128i count = _mm_cvtsi32_si128(shift);
+    lo = _mm_and_si128(_mm_srl_epi32(lo,count),mask);
+    hi = _mm_and_si128(_mm_srl_epi32(hi,count),mask);
+    return _mm_packs_epi32(lo,hi);
+}
+
+static inline __m128i pack565( __m128i r, __m128i g, __m128i b )
+{
+    return _mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(r,3),11),
+           _mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(g,2),5),_mm_srli_epi16(b,3)));
+}
+
+/// mask ? x : y per 16 bit lane
+static inline __m128i select16( __m128i mask, __m128i x, __m128i y )
+{
+    return _mm_or_si128(_mm_and_si128(mask,x),_mm_andnot_si128(mask,y));
+}
+
+void blend_span_565( const Uint32* src, Uint16* dst, int w, int rshift, int gshift, int bshift, int ashift )
+{
+    const __m128i c256 = _mm_set1_epi16(256);
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i m6 = _mm_set1_epi16(0x3f);
+    const __m128i m5 = _mm_set1_epi16(0x1f);
+
+    int i=0;
+    for (; i+8<=w; i+=8) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(src+i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(src+i+4));
+
+        __m128i a = channel16(lo,hi,ashift);
+        __m128i clear = _mm_cmpeq_epi16(a,_mm_setzero_si128());
+        if (_mm_movemask_epi8(clear)==0xffff) {
+            continue; // fully transparent, common around icons
+        }
+        __m128i opaque = _mm_cmpeq_epi16(a,c255);
+        __m128i sr = channel16(lo,hi,rshift);
+        __m128i sg = channel16(lo,hi,gshift);
+        __m128i sb = channel16(lo,hi,bshift);
+        __m128i copy = pack565(sr,sg,sb);
+        if (_mm_movemask_epi8(opaque)==0xffff) {
+            _mm_storeu_si128((__m128i*)(dst+i),copy);
+            continue;
+        }
+        __m128i ia = _mm_sub_epi16(c256,a);
+
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst+i));
+        __m128i dr = _mm_slli_epi16(_mm_srli_epi16(d,11),3);
+        __m128i dg = _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(d,5),m6),2);
+        __m128i db = _mm_slli_epi16(_mm_and_si128(d,m5),3);
+
+        __m128i r = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(sr,a),_mm_mullo_epi16(dr,ia)),8);
+        __m128i g = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(sg,a),_mm_mullo_epi16(dg,ia)),8);
+        __m128i b = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(sb,a),_mm_mullo_epi16(db,ia)),8);
+
+        __m128i out = select16(opaque,copy,pack565(r,g,b));
+        _mm_storeu_si128((__m128i*)(dst+i),select16(clear,d,out));
+    }
+    blend_span_565_scalar(src+i,dst+i,w-i,rshift,gshift,bshift,ashift);
+}
+
+#elif defined(BLEND_NEON)
+
+static inline uint16x8_t channel16( const uint8x8x4_t& px, int shift )
+{
+    // little endian: the byte index within the pixel is shift/8
+    switch (shift) {
+    case 0: return vmovl_u8(px.val[0]);
+    case 8: return vmovl_u8(px.val[1]);
+    case 16: return vmovl_u8(px.val[2]);
+    default: return vmovl_u8(px.val[3]);
+    }
+}
+
+static inline uint16x8_t pack565( uint16x8_t r, uint16x8_t g, uint16x8_t b )
+{
+    return vorrq_u16(vshlq_n_u16(vshrq_n_u16(r,3),11),
+           vorrq_u16(vshlq_n_u16(vshrq_n_u16(g,2),5),vshrq_n_u16(b,3)));
+}
+
+void blend_span_565( const Uint32* src, Uint16* dst, int w, int rshift, int gshift, int bshift, int ashift )
+{
+    const uint16x8_t c256 = vdupq_n_u16(256);
+    const uint16x8_t c255 = vdupq_n_u16(255);
+    const uint16x8_t m6 = vdupq_n_u16(0x3f);
+    const uint16x8_t m5 = vdupq_n_u16(0x1f);
+
+    int i=0;
+    for (; i+8<=w; i+=8) {
+        uint8x8x4_t px = vld4_u8((const uint8_t*)(src+i));
+
+        uint16x8_t a = channel16(px,ashift);
+        uint64x2_t any = vreinterpretq_u64_u16(a);
+        if ((vgetq_lane_u64(any,0)|vgetq_lane_u64(any,1))==0) {
+            continue; // fully transparent, common around icons
+        }
+        uint16x8_t clear = vceqq_u16(a,vdupq_n_u16(0));
+        uint16x8_t opaque = vceqq_u16(a,c255);
+        uint16x8_t sr = channel16(px,rshift);
+        uint16x8_t sg = channel16(px,gshift);
+        uint16x8_t sb = channel16(px,bshift);
+        uint16x8_t copy = pack565(sr,sg,sb);
+        uint16x8_t ia = vsubq_u16(c256,a);
+
+        uint16x8_t d = vld1q_u16(dst+i);
+        uint16x8_t dr = vshlq_n_u16(vshrq_n_u16(d,11),3);
+        uint16x8_t dg = vshlq_n_u16(vandq_u16(vshrq_n_u16(d,5),m6),2);
+        uint16x8_t db = vshlq_n_u16(vandq_u16(d,m5),3);
+
+        uint16x8_t r = vshrq_n_u16(vmlaq_u16(vmulq_u16(sr,a),dr,ia),8);
+        uint16x8_t g = vshrq_n_u16(vmlaq_u16(vmulq_u16(sg,a),dg,ia),8);
+        uint16x8_t b = vshrq_n_u16(vmlaq_u16(vmulq_u16(sb,a),db,ia),8);
+
+        uint16x8_t out = vbslq_u16(opaque,copy,pack565(r,g,b));
+        vst1q_u16(dst+i,vbslq_u16(clear,d,out));
+    }
+    blend_span_565_scalar(src+i,dst+i,w-i,rshift,gshift,bshift,ashift);
+}
+
+#else
+
+void blend_span_565( const Uint32* src, Uint16* dst, int w, int rshift, int gshift, int bshift, int ashift )
+{
+    blend_span_565_scalar(src,dst,w,rshift,gshift,bshift,ashift);
+}
+
+#endif
+
+
+static bool is_565( const SDL_PixelFormat* fmt )
+{
+    return fmt->BitsPerPixel==16 && fmt->Rmask==0xf800 && fmt->Gmask==0x07e0 && fmt->Bmask==0x001f;
+}
+
+static bool is_byte_rgba( const SDL_PixelFormat* fmt )
+{
+    return fmt->BitsPerPixel==32 && fmt->Amask!=0
+        && (fmt->Rshift&7)==0 && (fmt->Gshift&7)==0 && (fmt->Bshift&7)==0 && (fmt->Ashift&7)==0
+        && fmt->Rloss==0 && fmt->Gloss==0 && fmt->Bloss==0 && fmt->Aloss==0;
+}
+
+bool blend_blit( SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst, SDL_Rect* dstrect )
+{
+    if (!(src->flags&SDL_SRCALPHA) || !is_byte_rgba(src->format) || !is_565(dst->format)) {
+        return false;
+    }
+    SDL_Rect full = {0,0,Uint16(src->w),Uint16(src->h)};
+    SDL_Rect s = srcrect ? *srcrect : full;
+    int dx = dstrect ? dstrect->x : 0;
+    int dy = dstrect ? dstrect->y : 0;
+
+    // clip against the source surface
+    if (s.x<0) { dx -= s.x; s.w += s.x; s.x = 0; }
+    if (s.y<0) { dy -= s.y; s.h += s.y; s.y = 0; }
+    int w = s.w, h = s.h;
+    if (s.x+w>src->w) w = src->w-s.x;
+    if (s.y+h>src->h) h = src->h-s.y;
+
+    // clip against the target clip rect
+    const SDL_Rect& clip = dst->clip_rect;
+    int sx = s.x, sy = s.y;
+    if (dx<clip.x) { sx += clip.x-dx; w -= clip.x-dx; dx = clip.x; }
+    if (dy<clip.y) { sy += clip.y-dy; h -= clip.y-dy; dy = clip.y; }
+    if (dx+w>clip.x+clip.w) w = clip.x+clip.w-dx;
+    if (dy+h>clip.y+clip.h) h = clip.y+clip.h-dy;
+
+    if (w<=0 || h<=0) {
+        if (dstrect) { dstrect->w = 0; dstrect->h = 0; }
+        return true;
+    }
+
+    if (SDL_MUSTLOCK(dst) && SDL_LockSurface(dst)<0) return false;
+    if (SDL_MUSTLOCK(src) && SDL_LockSurface(src)<0) {
+        if (SDL_MUSTLOCK(dst)) SDL_UnlockSurface(dst);
+        return false;
+    }
+
+    const SDL_PixelFormat* fmt = src->format;
+    for (int y=0; y<h; y++) {
+        const Uint32* sp = (const Uint32*)((const Uint8*)src->pixels + (sy+y)*src->pitch) + sx;
+        Uint16* dp = (Uint16*)((Uint8*)dst->pixels + (dy+y)*dst->pitch) + dx;
+        blend_span_565(sp,dp,w,fmt->Rshift,fmt->Gshift,fmt->Bshift,fmt->Ashift);
+    }
+
+    if (SDL_MUSTLOCK(src)) SDL_UnlockSurface(src);
+    if (SDL_MUSTLOCK(dst)) SDL_UnlockSurface(dst);
+
+    if (dstrect) {
+        dstrect->x = dx; dstrect->y = dy;
+        dstrect->w = w; dstrect->h = h;
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef BLEND_H
+#define BLEND_H
+
+#include <SDL.h>
+
+
+/// alpha blends a 32 bit surface with an alpha channel onto a 16 bit 565 surface,
+/// honoring the target clip rect like SDL_BlitSurface.
+/// returns false without drawing if the formats are not covered, the caller
+/// should fall back to SDL_BlitSurface then.
+bool blend_blit( SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst, SDL_Rect* dstrect );
+
+/// blends one span of w pixels, src channels are picked by their bit shifts (multiples of 8).
+/// alpha 0 leaves the target untouched and alpha 255 stores the source truncated to 565, exactly.
+/// anything in between is d + (((s-d)*a)>>8) per 8 bit channel, which stays within two 565
+/// levels of SDL_BlitSurface (its ARGB to 565 blit works with 5 bit alpha), but is not equal to it
+void blend_span_565( const Uint32* src, Uint16* dst, int w, int rshift, int gshift, int bshift, int ashift );
+
+/// plain C version of blend_span_565, used for the span tails and as reference
+void blend_span_565_scalar( const Uint32* src, Uint16* dst, int w, int rshift, int gshift, int bshift, int ashift );
+
+#endif
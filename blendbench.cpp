@@ -0,0 +1,211 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "blendbench.h"
+#include "blend.h"
+#include <SDL.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <iostream>
+
+using namespace std;
+
+#define BLENDMAXERROR 2     // in 565 levels per channel, SDL works with 5 bit alpha
+#define BLENDWIDTH    251   // not a multiple of 8, so the span tails are covered too
+#define BLENDHEIGHT   64
+
+
+static double now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return tv.tv_sec*1000000.0+tv.tv_usec;
+}
+
+/// random colors, every alpha value appears in every column block, with runs of 0 and 255 like icons have
+static SDL_Surface* create_test_source( Uint32 rmask, Uint32 gmask, Uint32 bmask )
+{
+    SDL_Surface* src = SDL_CreateRGBSurface(SDL_SWSURFACE,BLENDWIDTH,BLENDHEIGHT,32,rmask,gmask,bmask,0xff000000);
+    if (src==NULL) {
+        return NULL;
+    }
+    srand(int(rmask));
+    for (int y=0; y<BLENDHEIGHT; y++) {
+        Uint32* p = (Uint32*)((Uint8*)src->pixels+y*src->pitch);
+        for (int x=0; x<BLENDWIDTH; x++) {
+            Uint32 a = (y&3)==0 ? 0 : ((y&3)==1 ? 255 : Uint32(x+y*BLENDWIDTH)&255);
+            p[x] = (a<<24) | (rand()&0xffffff);
+        }
+    }
+    SDL_SetAlpha(src,SDL_SRCALPHA,SDL_ALPHA_OPAQUE);
+    return src;
+}
+
+static SDL_Surface* create_target()
+{
+    SDL_Surface* dst = SDL_CreateRGBSurface(SDL_SWSURFACE,BLENDWIDTH,BLENDHEIGHT,16,0xf800,0x07e0,0x001f,0);
+    if (dst==NULL) {
+        return NULL;
+    }
+    srand(565);
+    for (int y=0; y<BLENDHEIGHT; y++) {
+        Uint16* p = (Uint16*)((Uint8*)dst->pixels+y*dst->pitch);
+        for (int x=0; x<BLENDWIDTH; x++) {
+            p[x] = Uint16(rand());
+        }
+    }
+    return dst;
+}
+
+static void copy_pixels( SDL_Surface* from, SDL_Surface* to )
+{
+    for (int y=0; y<from->h; y++) {
+        memcpy((Uint8*)to->pixels+y*to->pitch,(Uint8*)from->pixels+y*from->pitch,from->w*2);
+    }
+}
+
+static void blend_spans( SDL_Surface* src, SDL_Surface* dst, bool scalar )
+{
+    const SDL_PixelFormat* f = src->format;
+    for (int y=0; y<src->h; y++) {
+        const Uint32* s = (const Uint32*)((Uint8*)src->pixels+y*src->pitch);
+        Uint16* d = (Uint16*)((Uint8*)dst->pixels+y*dst->pitch);
+        if (scalar) blend_span_565_scalar(s,d,src->w,f->Rshift,f->Gshift,f->Bshift,f->Ashift);
+        else blend_span_565(s,d,src->w,f->Rshift,f->Gshift,f->Bshift,f->Ashift);
+    }
+}
+
+static int channel_error( Uint16 a, Uint16 b )
+{
+    int dr = abs((a>>11)-(b>>11));
+    int dg = abs(((a>>5)&0x3f)-((b>>5)&0x3f));
+    int db = abs((a&0x1f)-(b&0x1f));
+    return dr>dg ? (dr>db ? dr : db) : (dg>db ? dg : db);
+}
+
+struct BlendCheck
+{
+    int mismatches;     // vector or blend_blit against the C version
+    int inexact;        // alpha 0 or 255 not reproduced exactly
+    int maxerror;       // against SDL_BlitSurface
+};
+
+static BlendCheck compare( SDL_Surface* src, SDL_Surface* target, SDL_Surface* sdl,
+                           SDL_Surface* scalar, SDL_Surface* vector, SDL_Surface* blit )
+{
+    const SDL_PixelFormat* f = src->format;
+    BlendCheck check = {0,0,0};
+    for (int y=0; y<src->h; y++) {
+        const Uint32* s = (const Uint32*)((Uint8*)src->pixels+y*src->pitch);
+        const Uint16* t = (const Uint16*)((Uint8*)target->pixels+y*target->pitch);
+        const Uint16* r = (const Uint16*)((Uint8*)sdl->pixels+y*sdl->pitch);
+        const Uint16* c = (const Uint16*)((Uint8*)scalar->pixels+y*scalar->pitch);
+        const Uint16* v = (const Uint16*)((Uint8*)vector->pixels+y*vector->pitch);
+        const Uint16* b = (const Uint16*)((Uint8*)blit->pixels+y*blit->pitch);
+        for (int x=0; x<src->w; x++) {
+            if (v[x]!=c[x] || b[x]!=c[x]) check.mismatches ++;
+
+            Uint32 a = (s[x]>>f->Ashift)&0xff;
+            Uint16 opaque = Uint16(((((s[x]>>f->Rshift)&0xff)>>3)<<11) | ((((s[x]>>f->Gshift)&0xff)>>2)<<5) | (((s[x]>>f->Bshift)&0xff)>>3));
+            if ((a==0 && c[x]!=t[x]) || (a==255 && c[x]!=opaque)) check.inexact ++;
+
+            int error = channel_error(c[x],r[x]);
+            if (error>check.maxerror) check.maxerror = error;
+        }
+    }
+    return check;
+}
+
+int run_blend_benchmark( int iterations )
+{
+    // the launcher's own icons and the ones SDL_image hands out
+    static const struct { const char* name; Uint32 rmask, gmask, bmask; } formats[] = {
+        { "argb", 0x00ff0000, 0x0000ff00, 0x000000ff },
+        { "abgr", 0x000000ff, 0x0000ff00, 0x00ff0000 },
+    };
+    int failed = 0;
+
+    cout << "alpha blend onto 565, " << BLENDWIDTH << "x" << BLENDHEIGHT << ", " << iterations << " iterations" << endl;
+    for (size_t i=0; i<sizeof(formats)/sizeof(formats[0]); i++) {
+        SDL_Surface* src = create_test_source(formats[i].rmask,formats[i].gmask,formats[i].bmask);
+        SDL_Surface* target = create_target();
+        SDL_Surface* sdl = create_target();
+        SDL_Surface* scalar = create_target();
+        SDL_Surface* vector = create_target();
+        SDL_Surface* blit = create_target();
+        if (src==NULL || target==NULL || sdl==NULL || scalar==NULL || vector==NULL || blit==NULL) {
+            return 1;
+        }
+
+        SDL_BlitSurface(src,NULL,sdl,NULL);
+        blend_spans(src,scalar,true);
+        blend_spans(src,vector,false);
+        bool handled = blend_blit(src,NULL,blit,NULL);
+
+        BlendCheck check = compare(src,target,sdl,scalar,vector,blit);
+        bool bad = !handled || check.mismatches || check.inexact || check.maxerror>BLENDMAXERROR;
+        if (bad) failed ++;
+
+        double start = now_us();
+        for (int n=0; n<iterations; n++) {
+            copy_pixels(target,vector);
+            blend_spans(src,vector,false);
+        }
+        double vectortime = (now_us()-start)/iterations;
+
+        start = now_us();
+        for (int n=0; n<iterations; n++) {
+            copy_pixels(target,scalar);
+            blend_spans(src,scalar,true);
+        }
+        double scalartime = (now_us()-start)/iterations;
+
+        start = now_us();
+        for (int n=0; n<iterations; n++) {
+            copy_pixels(target,sdl);
+            SDL_BlitSurface(src,NULL,sdl,NULL);
+        }
+        double sdltime = (now_us()-start)/iterations;
+
+        cout << "  " << formats[i].name << "  blend_span_565 " << vectortime << "us, scalar " << scalartime
+             << "us, SDL_BlitSurface " << sdltime << "us"
+             << ", mismatches " << check.mismatches << ", inexact 0/255 " << check.inexact
+             << ", max error to SDL " << check.maxerror << (handled ? "" : ", blend_blit declined")
+             << (bad ? " FAILED" : "") << endl;
+
+        SDL_FreeSurface(blit);
+        SDL_FreeSurface(vector);
+        SDL_FreeSurface(scalar);
+        SDL_FreeSurface(sdl);
+        SDL_FreeSurface(target);
+        SDL_FreeSurface(src);
+    }
+    return failed ? 1 : 0;
+}
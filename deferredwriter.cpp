@@ -0,0 +1,131 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "deferredwriter.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+DeferredWriter::DeferredWriter( int delay ) :
+    m_delay(delay),
+    m_writing(false),
+    m_quit(false)
+{
+    m_mutex = SDL_CreateMutex();
+    m_cond = SDL_CreateCond();
+    m_done_cond = SDL_CreateCond();
+    m_thread = SDL_CreateThread(thread_main,this);
+}
+
+DeferredWriter::~DeferredWriter()
+{
+    SDL_LockMutex(m_mutex);
+    m_quit = true;
+    SDL_CondSignal(m_cond);
+    SDL_UnlockMutex(m_mutex);
+
+    if (m_thread) {
+        SDL_WaitThread(m_thread,NULL);
+    }
+    write_batch(); // anything the thread did not get to, or everything if it never started
+
+    SDL_DestroyCond(m_done_cond);
+    SDL_DestroyCond(m_cond);
+    SDL_DestroyMutex(m_mutex);
+}
+
+void DeferredWriter::write( const std::string& path, char* data, size_t size )
+{
+    Item item = {path,data,size};
+    SDL_LockMutex(m_mutex);
+    m_queue.push_back(item);
+    SDL_CondSignal(m_cond);
+    SDL_UnlockMutex(m_mutex);
+
+    if (m_thread==NULL) {
+        write_batch();
+    }
+}
+
+void DeferredWriter::flush()
+{
+    if (m_thread==NULL) {
+        write_batch();
+        return;
+    }
+    SDL_LockMutex(m_mutex);
+    while (!m_queue.empty() || m_writing) {
+        SDL_CondSignal(m_cond);
+        SDL_CondWaitTimeout(m_done_cond,m_mutex,m_delay);
+    }
+    SDL_UnlockMutex(m_mutex);
+}
+
+void DeferredWriter::write_batch()
+{
+    std::vector<Item> batch;
+    SDL_LockMutex(m_mutex);
+    batch.swap(m_queue);
+    m_writing = true;
+    SDL_UnlockMutex(m_mutex);
+
+    for (int i=0,n=batch.size(); i<n; i++) {
+        FILE* fp = fopen(batch[i].path.c_str(),"wb");
+        if (fp) {
+            fwrite(batch[i].data,batch[i].size,1,fp);
+            fclose(fp);
+        }
+        free(batch[i].data);
+    }
+
+    SDL_LockMutex(m_mutex);
+    m_writing = false;
+    SDL_CondBroadcast(m_done_cond);
+    SDL_UnlockMutex(m_mutex);
+}
+
+int DeferredWriter::thread_main( void* data )
+{
+    DeferredWriter* writer = (DeferredWriter*)data;
+
+    SDL_LockMutex(writer->m_mutex);
+    while (!writer->m_quit) {
+        if (writer->m_queue.empty()) {
+            SDL_CondWait(writer->m_cond,writer->m_mutex);
+            continue;
+        }
+        // give the icon workers a moment to queue more, then write them in one go
+        SDL_UnlockMutex(writer->m_mutex);
+        SDL_Delay(writer->m_delay);
+        writer->write_batch();
+        SDL_LockMutex(writer->m_mutex);
+    }
+    SDL_UnlockMutex(writer->m_mutex);
+    return 0;
+}
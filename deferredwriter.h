@@ -0,0 +1,77 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef DEFERREDWRITER_H
+#define DEFERREDWRITER_H
+
+#include <SDL.h>
+#include <string>
+#include <vector>
+
+
+/// writes files on a background thread in batches, so cache persistence never
+/// sits between an icon decode and its display. files are written in queue order
+class DeferredWriter
+{
+public:
+    /// delay: milliseconds to wait for more writes before a batch goes to disk
+    DeferredWriter( int delay );
+
+    /// writes everything still queued, then stops the thread
+    virtual ~DeferredWriter();
+
+    /// queue data for path, takes ownership of the malloc'ed data
+    void write( const std::string& path, char* data, size_t size );
+
+    /// blocks until the queue is on disk
+    void flush();
+
+protected:
+    static int thread_main( void* data );
+    void write_batch();
+
+private:
+    struct Item
+    {
+        std::string path;
+        char* data;
+        size_t size;
+    };
+
+    std::vector<Item> m_queue;
+    SDL_Thread* m_thread;
+    SDL_mutex* m_mutex;
+    SDL_cond* m_cond;
+    SDL_cond* m_done_cond;
+    int m_delay;
+    bool m_writing;
+    bool m_quit;
+};
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "dirtyrects.h"
+
+// once the dirty area covers this share of the screen a full redraw is cheaper
+#define FULLREDRAWPERCENT 50
+
+
+bool intersect_rect( const SDL_Rect& a, const SDL_Rect& b, SDL_Rect* out )
+{
+    int x0 = a.x>b.x ? a.x : b.x;
+    int y0 = a.y>b.y ? a.y : b.y;
+    int x1 = a.x+a.w<b.x+b.w ? a.x+a.w : b.x+b.w;
+    int y1 = a.y+a.h<b.y+b.h ? a.y+a.h : b.y+b.h;
+    if (x1<=x0 || y1<=y0) {
+        return false;
+    }
+    if (out) {
+        out->x = x0; out->y = y0;
+        out->w = x1-x0; out->h = y1-y0;
+    }
+    return true;
+}
+
+SDL_Rect union_rect( const SDL_Rect& a, const SDL_Rect& b )
+{
+    int x0 = a.x<b.x ? a.x : b.x;
+    int y0 = a.y<b.y ? a.y : b.y;
+    int x1 = a.x+a.w>b.x+b.w ? a.x+a.w : b.x+b.w;
+    int y1 = a.y+a.h>b.y+b.h ? a.y+a.h : b.y+b.h;
+    SDL_Rect r = {Sint16(x0),Sint16(y0),Uint16(x1-x0),Uint16(y1-y0)};
+    return r;
+}
+
+
+DirtyRects::DirtyRects( int width, int height ) :
+    m_full(false),
+    m_band(false)
+{
+    SDL_Rect screen = {0,0,Uint16(width),Uint16(height)};
+    m_screen = screen;
+}
+
+void DirtyRects::add( const SDL_Rect& rect )
+{
+    if (m_full) {
+        return;
+    }
+    merge(rect);
+    if (m_band) {
+        return;
+    }
+
+    int area = 0;
+    for (int i=0,n=m_rects.size(); i<n; i++) {
+        area += m_rects[i].w*m_rects[i].h;
+    }
+    if (area*100 >= m_screen.w*m_screen.h*FULLREDRAWPERCENT) {
+        invalidate_all();
+    }
+}
+
+void DirtyRects::add_band( const SDL_Rect& rect )
+{
+    if (m_full) {
+        return;
+    }
+    merge(rect);
+    m_band = true;
+}
+
+void DirtyRects::merge( const SDL_Rect& rect )
+{
+    SDL_Rect r;
+    if (!intersect_rect(rect,m_screen,&r)) {
+        return;
+    }
+
+    // merge with everything it touches, repeat since the grown rect may touch more
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (int i=0,n=m_rects.size(); i<n; i++) {
+            if (intersect_rect(m_rects[i],r,NULL)) {
+                r = union_rect(m_rects[i],r);
+                m_rects.erase(m_rects.begin()+i);
+                merged = true;
+                break;
+            }
+        }
+    }
+    m_rects.push_back(r);
+}
+
+void DirtyRects::invalidate_all()
+{
+    m_full = true;
+    m_rects.clear();
+    m_rects.push_back(m_screen);
+}
+
+void DirtyRects::clear()
+{
+    m_full = false;
+    m_band = false;
+    m_rects.clear();
+}
@@ -0,0 +1,89 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef DIRTYRECTS_H
+#define DIRTYRECTS_H
+
+#include <SDL.h>
+#include <vector>
+
+
+/// returns false if a and b do not overlap, out receives the overlapping area otherwise
+bool intersect_rect( const SDL_Rect& a, const SDL_Rect& b, SDL_Rect* out );
+
+/// smallest rect containing a and b
+SDL_Rect union_rect( const SDL_Rect& a, const SDL_Rect& b );
+
+
+/// collects the screen areas that changed since the last present
+class DirtyRects
+{
+public:
+    DirtyRects( int width, int height );
+
+    /// marks an area for redraw, overlapping areas are merged
+    void add( const SDL_Rect& rect );
+
+    /// marks a large area that is redrawn as one, e.g. the grid band while it scrolls.
+    /// merged like add(), but the update stays partial for the rest of the frame however
+    /// much it covers, the rows outside the band are never pushed for nothing
+    void add_band( const SDL_Rect& rect );
+
+    /// forces the next present to redraw the whole screen
+    void invalidate_all();
+
+    bool empty() const
+    {
+        return !m_full && m_rects.empty();
+    }
+
+    bool is_full() const
+    {
+        return m_full;
+    }
+
+    /// the areas to redraw, a single screen sized rect if is_full()
+    const std::vector<SDL_Rect>& get_rects() const
+    {
+        return m_rects;
+    }
+
+    void clear();
+
+protected:
+    void merge( const SDL_Rect& rect );
+
+private:
+    std::vector<SDL_Rect> m_rects;
+    SDL_Rect m_screen;
+    bool m_full;
+    bool m_band;
+};
+
+#endif
@@ -0,0 +1,184 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "folderwatcher.h"
+#include <sys/inotify.h>
+#include <sys/select.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <iostream>
+
+using namespace std;
+
+
+FolderWatcher::FolderWatcher( const string& directory, const string& extension, int settledelay, int eventcode ) :
+    m_extension(extension),
+    m_thread(NULL),
+    m_settle_delay(settledelay),
+    m_event_code(eventcode),
+    m_fd(-1),
+    m_notified(false),
+    m_overflowed(false)
+{
+    m_mutex = SDL_CreateMutex();
+    m_wakeup[0] = m_wakeup[1] = -1;
+
+    m_fd = inotify_init();
+    if (m_fd<0) {
+        cerr << "Failed to init inotify: " << strerror(errno) << endl;
+        return;
+    }
+    // close_write instead of create, a copy is only picked up once it is complete
+    Uint32 mask = IN_CLOSE_WRITE|IN_MOVED_TO|IN_DELETE|IN_MOVED_FROM;
+    if (inotify_add_watch(m_fd,directory.c_str(),mask)<0 || pipe(m_wakeup)!=0) {
+        cerr << "Failed to watch directory: " << directory << endl;
+        close(m_fd);
+        m_fd = -1;
+        return;
+    }
+    // launched apps have no business with these
+    fcntl(m_fd,F_SETFD,FD_CLOEXEC);
+    fcntl(m_wakeup[0],F_SETFD,FD_CLOEXEC);
+    fcntl(m_wakeup[1],F_SETFD,FD_CLOEXEC);
+    m_thread = SDL_CreateThread(thread_main,this);
+}
+
+FolderWatcher::~FolderWatcher()
+{
+    if (m_thread) {
+        char quit = 0;
+        while (write(m_wakeup[1],&quit,1)<0 && errno==EINTR) {}
+        SDL_WaitThread(m_thread,NULL);
+    }
+    if (m_wakeup[0]>=0) close(m_wakeup[0]);
+    if (m_wakeup[1]>=0) close(m_wakeup[1]);
+    if (m_fd>=0) close(m_fd);
+    SDL_DestroyMutex(m_mutex);
+}
+
+void FolderWatcher::collect( Changes* changes, bool* overflowed )
+{
+    SDL_LockMutex(m_mutex);
+    changes->swap(m_changes);
+    m_changes.clear();
+    *overflowed = m_overflowed;
+    m_overflowed = false;
+    m_notified = false;
+    SDL_UnlockMutex(m_mutex);
+}
+
+int FolderWatcher::thread_main( void* data )
+{
+    ((FolderWatcher*)data)->run();
+    return 0;
+}
+
+void FolderWatcher::run()
+{
+    Changes batch;
+    bool overflowed = false;
+    bool unsent = false;   // published, but the wake-up did not get into the event queue
+    for (;;)
+    {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(m_fd,&fds);
+        FD_SET(m_wakeup[0],&fds);
+        int maxfd = m_fd>m_wakeup[0] ? m_fd : m_wakeup[0];
+
+        // block until something happens, then keep gathering until the folder settles
+        struct timeval timeout;
+        timeout.tv_sec = m_settle_delay/1000;
+        timeout.tv_usec = (m_settle_delay%1000)*1000;
+        int r = select(maxfd+1,&fds,NULL,NULL,batch.empty() && !overflowed && !unsent ? NULL : &timeout);
+
+        if (r<0) {
+            if (errno==EINTR) continue;
+            cerr << "Folder watch failed: " << strerror(errno) << endl;
+            break;
+        }
+        if (r==0) {
+            unsent = !publish(&batch,&overflowed);
+            continue;
+        }
+        if (FD_ISSET(m_wakeup[0],&fds)) {
+            break;
+        }
+        read_events(&batch,&overflowed);
+    }
+}
+
+void FolderWatcher::read_events( Changes* batch, bool* overflowed )
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len = read(m_fd,buf,sizeof(buf));
+    for (char* p=buf; len>0 && p<buf+len; )
+    {
+        const struct inotify_event* event = (const struct inotify_event*)p;
+        p += sizeof(struct inotify_event)+event->len;
+
+        if (event->mask&IN_Q_OVERFLOW) {
+            cerr << "Folder watch overflowed, rescanning" << endl;
+            *overflowed = true;
+            continue;
+        }
+        if (event->len==0 || (event->mask&IN_ISDIR)) {
+            continue;
+        }
+        const char* ext = strrchr(event->name,'.');
+        if (ext==NULL || m_extension!=ext) {
+            continue;
+        }
+        // the last event wins, e.g. a delete followed by a copy is a replace
+        (*batch)[event->name] = (event->mask&(IN_CLOSE_WRITE|IN_MOVED_TO)) ? ADDED : REMOVED;
+    }
+}
+
+bool FolderWatcher::publish( Changes* batch, bool* overflowed )
+{
+    SDL_LockMutex(m_mutex);
+    for (Changes::const_iterator it=batch->begin(); it!=batch->end(); ++it) {
+        m_changes[it->first] = it->second;
+    }
+    batch->clear();
+    m_overflowed = m_overflowed || *overflowed;
+    *overflowed = false;
+    if (!m_notified) {
+        SDL_Event event;
+        memset(&event,0,sizeof(event));
+        event.type = SDL_USEREVENT;
+        event.user.code = m_event_code;
+        m_notified = SDL_PushEvent(&event)==0;
+    }
+    bool notified = m_notified;
+    SDL_UnlockMutex(m_mutex);
+    return notified;
+}
@@ -0,0 +1,82 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef FOLDERWATCHER_H
+#define FOLDERWATCHER_H
+
+#include <SDL.h>
+#include <string>
+#include <map>
+
+
+/// watches one folder with inotify on a background thread. changes to files with the
+/// given extension are collected until the folder has been quiet for settledelay ms,
+/// then the main loop is woken with one SDL_USEREVENT carrying eventcode
+class FolderWatcher
+{
+public:
+    enum Change
+    {
+        ADDED,      // created, copied over or moved in
+        REMOVED     // deleted or moved away
+    };
+
+    /// file name -> last change seen for it
+    typedef std::map<std::string,Change> Changes;
+
+    FolderWatcher( const std::string& directory, const std::string& extension, int settledelay, int eventcode );
+    virtual ~FolderWatcher();
+
+    /// takes the changes gathered so far, must be called from the main thread.
+    /// overflowed is set if inotify dropped events, changes is incomplete then and the
+    /// folder has to be rescanned
+    void collect( Changes* changes, bool* overflowed );
+
+protected:
+    static int thread_main( void* data );
+    void run();
+    void read_events( Changes* batch, bool* overflowed );
+    /// hands the batch to collect(). false if the wake-up could not be queued, e.g. the
+    /// event queue is full, it has to be tried again later
+    bool publish( Changes* batch, bool* overflowed );
+
+private:
+    std::string m_extension;
+    Changes m_changes;
+    SDL_Thread* m_thread;
+    SDL_mutex* m_mutex;
+    int m_settle_delay;
+    int m_event_code;
+    int m_fd;
+    int m_wakeup[2];
+    bool m_notified;
+    bool m_overflowed;
+};
+
+#endif
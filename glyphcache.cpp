@@ -0,0 +1,197 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "glyphcache.h"
+#include <string.h>
+
+#define GLYPHATLASWIDTH 512
+
+std::vector<GlyphCache*> GlyphCache::S_Caches;
+
+
+GlyphCache::GlyphCache( TTF_Font* font, const SDL_Color& color ) :
+    m_font(font),
+    m_color(color),
+    m_shelf_x(0),
+    m_shelf_y(0),
+    m_shelf_h(0)
+{
+    m_height = TTF_FontHeight(font);
+    m_ascent = TTF_FontAscent(font);
+    memset(m_glyphs,0,sizeof(m_glyphs));
+}
+
+GlyphCache::~GlyphCache()
+{
+}
+
+GlyphCache* GlyphCache::get( TTF_Font* font, const SDL_Color& color )
+{
+    for (int i=0,n=S_Caches.size(); i<n; i++) {
+        GlyphCache* cache = S_Caches[i];
+        if (cache->m_font==font && cache->m_color.r==color.r && cache->m_color.g==color.g && cache->m_color.b==color.b) {
+            return cache;
+        }
+    }
+    GlyphCache* cache = new GlyphCache(font,color);
+    S_Caches.push_back(cache);
+    return cache;
+}
+
+void GlyphCache::free_all()
+{
+    for (int i=0,n=S_Caches.size(); i<n; i++) {
+        delete S_Caches[i];
+    }
+    S_Caches.clear();
+}
+
+const GlyphCache::Glyph& GlyphCache::glyph( unsigned char ch )
+{
+    Glyph& g = m_glyphs[ch];
+    if (!g.loaded) {
+        load_glyph(ch,&g);
+    }
+    return g;
+}
+
+void GlyphCache::load_glyph( unsigned char ch, Glyph* g )
+{
+    g->loaded = true;
+
+    int minx, maxx, miny, maxy, advance;
+    if (TTF_GlyphMetrics(m_font,ch,&minx,&maxx,&miny,&maxy,&advance)<0) {
+        return;
+    }
+    g->advance = advance;
+
+    SDL_Color white = {255,255,255,0};
+    SDL_Surface* surface = TTF_RenderGlyph_Blended(m_font,ch,white);
+    if (surface==NULL) {
+        return;
+    }
+
+    g->w = surface->w < GLYPHATLASWIDTH ? surface->w : GLYPHATLASWIDTH;
+    g->h = surface->h;
+    g->xoffset = minx;
+    // depending on the SDL_ttf version the glyph comes line high or cropped to its bitmap
+    g->yoffset = surface->h>=m_height ? 0 : m_ascent-maxy;
+
+    // shelf packing into the atlas
+    if (m_shelf_x+g->w>GLYPHATLASWIDTH) {
+        m_shelf_x = 0;
+        m_shelf_y += m_shelf_h;
+        m_shelf_h = 0;
+    }
+    g->x = m_shelf_x;
+    g->y = m_shelf_y;
+    m_shelf_x += g->w;
+    if (g->h>m_shelf_h) {
+        m_shelf_h = g->h;
+    }
+    if (int(m_atlas.size())<(g->y+g->h)*GLYPHATLASWIDTH) {
+        m_atlas.resize((g->y+g->h)*GLYPHATLASWIDTH,0);
+    }
+
+    SDL_LockSurface(surface);
+    const SDL_PixelFormat* fmt = surface->format;
+    for (int y=0; y<g->h; y++) {
+        const Uint8* row = (const Uint8*)surface->pixels + y*surface->pitch;
+        Uint8* dst = &m_atlas[(g->y+y)*GLYPHATLASWIDTH + g->x];
+        for (int x=0; x<g->w; x++) {
+            Uint32 pixel = 0;
+            memcpy(&pixel,row+x*fmt->BytesPerPixel,fmt->BytesPerPixel);
+            Uint8 r, gr, b, a;
+            SDL_GetRGBA(pixel,fmt,&r,&gr,&b,&a);
+            dst[x] = a;
+        }
+    }
+    SDL_UnlockSurface(surface);
+    SDL_FreeSurface(surface);
+}
+
+int GlyphCache::get_width( const char* text )
+{
+    int pen = 0, right = 0;
+    for (const unsigned char* c=(const unsigned char*)text; *c; c++) {
+        const Glyph& g = glyph(*c);
+        int x = pen+g.xoffset;
+        if (x<0) x = 0;
+        if (x+g.w>right) right = x+g.w;
+        pen += g.advance;
+    }
+    return pen>right ? pen : right;
+}
+
+SDL_Surface* GlyphCache::render( const char* text )
+{
+    int width = get_width(text);
+    if (width<=0) {
+        return NULL;
+    }
+
+    SDL_Surface* surface = SDL_CreateRGBSurface(SDL_SWSURFACE, width, m_height, 32,
+                                   0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
+    if (surface==NULL) {
+        return NULL;
+    }
+
+    // one color for the whole line, the glyphs only contribute coverage;
+    // taking the max keeps overlapping glyph edges from darkening
+    SDL_LockSurface(surface);
+    Uint32 color = SDL_MapRGBA(surface->format,m_color.r,m_color.g,m_color.b,0);
+    for (int y=0; y<surface->h; y++) {
+        Uint32* row = (Uint32*)((Uint8*)surface->pixels + y*surface->pitch);
+        for (int x=0; x<surface->w; x++) row[x] = color;
+    }
+
+    const SDL_PixelFormat* fmt = surface->format;
+    int pen = 0;
+    for (const unsigned char* c=(const unsigned char*)text; *c; c++) {
+        const Glyph& g = glyph(*c);
+        int x0 = pen+g.xoffset;
+        if (x0<0) x0 = 0;
+        for (int y=0; y<g.h; y++) {
+            int ty = g.yoffset+y;
+            if (ty<0 || ty>=surface->h) continue;
+            const Uint8* src = &m_atlas[(g.y+y)*GLYPHATLASWIDTH + g.x];
+            Uint32* dst = (Uint32*)((Uint8*)surface->pixels + ty*surface->pitch) + x0;
+            for (int x=0; x<g.w && x0+x<surface->w; x++) {
+                Uint32 a = (dst[x]&fmt->Amask)>>fmt->Ashift;
+                if (src[x]>a) {
+                    dst[x] = (dst[x]&~fmt->Amask) | (Uint32(src[x])<<fmt->Ashift);
+                }
+            }
+        }
+        pen += g.advance;
+    }
+    SDL_UnlockSurface(surface);
+
+    return surface;
+}
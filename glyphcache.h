@@ -0,0 +1,87 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef GLYPHCACHE_H
+#define GLYPHCACHE_H
+
+#include <SDL.h>
+#include <SDL/SDL_ttf.h>
+#include <vector>
+
+
+/// rasterizes every glyph of one font (a TTF_Font already is a face at one size) in one color once
+/// into an alpha atlas and composes text from there, instead of TTF_RenderText_Blended per label
+class GlyphCache
+{
+public:
+    GlyphCache( TTF_Font* font, const SDL_Color& color );
+    virtual ~GlyphCache();
+
+    /// same contract as TTF_RenderText_Blended: a 32 bit RGBA surface or NULL for empty text
+    SDL_Surface* render( const char* text );
+
+    /// width in pixels text would be rendered with
+    int get_width( const char* text );
+
+    /// the shared cache for font and color, created on first use
+    static GlyphCache* get( TTF_Font* font, const SDL_Color& color );
+
+    /// drops all shared caches, call before the fonts are closed
+    static void free_all();
+
+protected:
+    struct Glyph
+    {
+        bool loaded;
+        int x, y;       // position in the atlas
+        int w, h;
+        int xoffset;    // from the pen position
+        int yoffset;    // from the top of the line
+        int advance;
+    };
+
+    const Glyph& glyph( unsigned char ch );
+    void load_glyph( unsigned char ch, Glyph* g );
+
+private:
+    TTF_Font* m_font;
+    SDL_Color m_color;
+    int m_height;
+    int m_ascent;
+    Glyph m_glyphs[256];
+
+    std::vector<Uint8> m_atlas;   // alpha only, GLYPHATLASWIDTH bytes per row
+    int m_shelf_x;
+    int m_shelf_y;
+    int m_shelf_h;
+
+    static std::vector<GlyphCache*> S_Caches;
+};
+
+#endif
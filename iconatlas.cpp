@@ -0,0 +1,137 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "iconatlas.h"
+
+
+IconAtlas::IconAtlas( int cellwidth, int cellheight, int pagesize ) :
+    m_cellwidth(cellwidth),
+    m_cellheight(cellheight),
+    m_pagesize(pagesize),
+    m_used(0)
+{
+}
+
+IconAtlas::~IconAtlas()
+{
+    for (int i=0,n=m_pages.size(); i<n; i++) {
+        SDL_FreeSurface(m_pages[i]);
+    }
+}
+
+bool IconAtlas::add( SDL_Surface* icon, SDL_Surface** page, SDL_Rect* rect )
+{
+    if (icon==NULL || icon->w>m_cellwidth || icon->h>m_cellheight) {
+        return false;
+    }
+
+    if (m_free.empty() && create_page()==NULL) {
+        return false;
+    }
+
+    Cell cell = m_free.back();
+    m_free.pop_back();
+    m_used ++;
+
+    *page = m_pages[cell.page];
+    rect->x = cell.x;
+    rect->y = cell.y;
+    rect->w = icon->w;
+    rect->h = icon->h;
+
+    // clear what the previous owner of the cell left behind
+    SDL_Rect cellrect = {Sint16(cell.x),Sint16(cell.y),Uint16(m_cellwidth),Uint16(m_cellheight)};
+    SDL_FillRect(*page,&cellrect,0);
+
+    // without SDL_SRCALPHA on the source the blit copies the alpha channel instead of blending
+    Uint32 flags = icon->flags&(SDL_SRCALPHA|SDL_RLEACCEL);
+    Uint8 alpha = icon->format->alpha;
+    SDL_SetAlpha(icon,0,0);
+    SDL_Rect target = *rect;
+    SDL_BlitSurface(icon,NULL,*page,&target);
+    SDL_SetAlpha(icon,flags,alpha);
+
+    return true;
+}
+
+void IconAtlas::remove( SDL_Surface* page, const SDL_Rect& rect )
+{
+    int p = find_page(page);
+    if (p>=0) {
+        Cell cell = {p,rect.x,rect.y};
+        m_free.push_back(cell);
+        m_used --;
+    }
+}
+
+size_t IconAtlas::get_bytes() const
+{
+    size_t bytes = 0;
+    for (int i=0,n=m_pages.size(); i<n; i++) {
+        bytes += m_pages[i]->pitch * m_pages[i]->h;
+    }
+    return bytes;
+}
+
+void IconAtlas::print_stats( std::ostream& out ) const
+{
+    int cells = (m_pagesize/m_cellwidth)*(m_pagesize/m_cellheight)*m_pages.size();
+    out << "icon atlas: " << get_bytes()/1024 << "kb in " << m_pages.size() << " pages, "
+        << m_used << " of " << cells << " cells used" << std::endl;
+}
+
+SDL_Surface* IconAtlas::create_page()
+{
+    SDL_Surface* page = SDL_CreateRGBSurface(SDL_SWSURFACE, m_pagesize, m_pagesize, 32,
+                                   0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
+    if (page==NULL) {
+        return NULL;
+    }
+    SDL_SetAlpha(page,SDL_SRCALPHA,SDL_ALPHA_OPAQUE);
+
+    int p = m_pages.size();
+    m_pages.push_back(page);
+
+    // hand out cells top-left first
+    int cols = m_pagesize/m_cellwidth;
+    int rows = m_pagesize/m_cellheight;
+    for (int i=cols*rows-1; i>=0; i--) {
+        Cell cell = {p,(i%cols)*m_cellwidth,(i/cols)*m_cellheight};
+        m_free.push_back(cell);
+    }
+    return page;
+}
+
+int IconAtlas::find_page( SDL_Surface* page ) const
+{
+    for (int i=0,n=m_pages.size(); i<n; i++) {
+        if (m_pages[i]==page) return i;
+    }
+    return -1;
+}
@@ -0,0 +1,87 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef ICONATLAS_H
+#define ICONATLAS_H
+
+#include <SDL.h>
+#include <vector>
+#include <iostream>
+
+
+/// packs equally sized icons into a few large pages instead of one surface per widget
+class IconAtlas
+{
+public:
+    IconAtlas( int cellwidth, int cellheight, int pagesize );
+    virtual ~IconAtlas();
+
+    /// copies the icon into a free cell and returns its page and sub rect,
+    /// fails if the icon is larger than a cell
+    bool add( SDL_Surface* icon, SDL_Surface** page, SDL_Rect* rect );
+
+    /// releases the cell at rect on page for reuse
+    void remove( SDL_Surface* page, const SDL_Rect& rect );
+
+    int get_page_count() const
+    {
+        return m_pages.size();
+    }
+
+    int get_used_cells() const
+    {
+        return m_used;
+    }
+
+    /// pixel memory held by all pages
+    size_t get_bytes() const;
+
+    void print_stats( std::ostream& out ) const;
+
+protected:
+    SDL_Surface* create_page();
+    int find_page( SDL_Surface* page ) const;
+
+private:
+    struct Cell
+    {
+        int page;
+        int x;
+        int y;
+    };
+
+    std::vector<SDL_Surface*> m_pages;
+    std::vector<Cell> m_free;
+    int m_cellwidth;
+    int m_cellheight;
+    int m_pagesize;
+    int m_used;
+};
+
+#endif
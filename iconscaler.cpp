@@ -0,0 +1,240 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "iconscaler.h"
+#include <vector>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+#define WEIGHTBITS 8
+#define WEIGHTONE  (1<<WEIGHTBITS)   // the weights of one target pixel add up to this, per axis
+
+// rgba in memory order on either endianness, alpha is always the 4th byte
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+#define RMASK 0xff000000
+#define GMASK 0x00ff0000
+#define BMASK 0x0000ff00
+#define AMASK 0x000000ff
+#else
+#define RMASK 0x000000ff
+#define GMASK 0x0000ff00
+#define BMASK 0x00ff0000
+#define AMASK 0xff000000
+#endif
+
+
+/// the source pixels under one target pixel, their weights start at offset
+struct Span
+{
+    int first;
+    int count;
+    int offset;
+};
+
+/// target pixel d covers source [d*srcsize/dstsize, (d+1)*srcsize/dstsize), all
+/// positions are kept in units of 1/dstsize source pixels, so this is exact
+static void compute_spans( int srcsize, int dstsize, vector<Span>* spans, vector<Uint16>* weights )
+{
+    spans->resize(dstsize);
+    weights->clear();
+    for (int d=0; d<dstsize; d++) {
+        int start = d*srcsize, end = start+srcsize;
+        Span& span = (*spans)[d];
+        span.first = start/dstsize;
+        span.count = (end-1)/dstsize-span.first+1;
+        span.offset = weights->size();
+
+        // rounding the running sum instead of every weight keeps the total at exactly WEIGHTONE
+        int covered = 0, given = 0;
+        for (int i=span.first; i<span.first+span.count; i++) {
+            int lo = i*dstsize>start ? i*dstsize : start;
+            int hi = (i+1)*dstsize<end ? (i+1)*dstsize : end;
+            covered += hi-lo;
+            int w = (covered*WEIGHTONE+srcsize/2)/srcsize-given;
+            given += w;
+            weights->push_back(w);
+        }
+    }
+}
+
+static inline Uint8 div255( int v )
+{
+    v += 128;
+    return Uint8((v+(v>>8))>>8);
+}
+
+/// one target row from one premultiplied source row, results are scaled by WEIGHTONE
+static void scale_row( const Uint8* src, Uint16* dst, const vector<Span>& spans, const vector<Uint16>& weights )
+{
+    for (int x=0,n=spans.size(); x<n; x++, dst+=4) {
+        const Span& span = spans[x];
+        const Uint8* p = src+span.first*4;
+        const Uint16* w = &weights[span.offset];
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+        uint16x4_t acc = vdup_n_u16(0);
+        for (int i=0; i<span.count; i++, p+=4) {
+            uint8x8_t px = vreinterpret_u8_u32(vld1_dup_u32((const uint32_t*)p));
+            acc = vmla_n_u16(acc,vget_low_u16(vmovl_u8(px)),w[i]);
+        }
+        vst1_u16(dst,acc);
+#elif defined(__SSE2__)
+        __m128i zero = _mm_setzero_si128();
+        __m128i acc = zero;
+        for (int i=0; i<span.count; i++, p+=4) {
+            __m128i px = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int*)p),zero);
+            acc = _mm_add_epi16(acc,_mm_mullo_epi16(px,_mm_set1_epi16(w[i])));
+        }
+        _mm_storel_epi64((__m128i*)dst,acc);
+#else
+        Uint16 r=0, g=0, b=0, a=0;
+        for (int i=0; i<span.count; i++, p+=4) {
+            r += p[0]*w[i];
+            g += p[1]*w[i];
+            b += p[2]*w[i];
+            a += p[3]*w[i];
+        }
+        dst[0] = r; dst[1] = g; dst[2] = b; dst[3] = a;
+#endif
+    }
+}
+
+/// acc += row*weight over count values
+static void accumulate_row( Uint32* acc, const Uint16* row, int count, Uint16 weight )
+{
+    int i = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; i+8<=count; i+=8) {
+        uint16x8_t v = vld1q_u16(row+i);
+        vst1q_u32(acc+i,vmlal_n_u16(vld1q_u32(acc+i),vget_low_u16(v),weight));
+        vst1q_u32(acc+i+4,vmlal_n_u16(vld1q_u32(acc+i+4),vget_high_u16(v),weight));
+    }
+#elif defined(__SSE2__)
+    __m128i w = _mm_set1_epi16(weight);
+    for (; i+8<=count; i+=8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(row+i));
+        __m128i lo = _mm_mullo_epi16(v,w);
+        __m128i hi = _mm_mulhi_epu16(v,w);
+        __m128i* a = (__m128i*)(acc+i);
+        _mm_storeu_si128(a,_mm_add_epi32(_mm_loadu_si128(a),_mm_unpacklo_epi16(lo,hi)));
+        _mm_storeu_si128(a+1,_mm_add_epi32(_mm_loadu_si128(a+1),_mm_unpackhi_epi16(lo,hi)));
+    }
+#endif
+    for (; i<count; i++) {
+        acc[i] += Uint32(row[i])*weight;
+    }
+}
+
+void get_scaled_size( int width, int height, int maxwidth, int maxheight, int* scaledwidth, int* scaledheight )
+{
+    // the tighter axis decides, the other one follows with the same factor
+    if (width*maxheight>height*maxwidth) {
+        *scaledwidth = width<maxwidth ? width : maxwidth;
+        *scaledheight = (height*(*scaledwidth)+width/2)/width;
+    } else {
+        *scaledheight = height<maxheight ? height : maxheight;
+        *scaledwidth = (width*(*scaledheight)+height/2)/height;
+    }
+    if (*scaledwidth<1) *scaledwidth = 1;
+    if (*scaledheight<1) *scaledheight = 1;
+}
+
+SDL_Surface* scale_icon( SDL_Surface* icon, int maxwidth, int maxheight )
+{
+    if (icon==NULL || icon->w<1 || icon->h<1) {
+        return NULL;
+    }
+    int dw, dh;
+    get_scaled_size(icon->w,icon->h,maxwidth,maxheight,&dw,&dh);
+
+    SDL_Surface* scaled = SDL_CreateRGBSurface(SDL_SWSURFACE,dw,dh,32,RMASK,GMASK,BMASK,AMASK);
+    if (scaled==NULL) {
+        return NULL;
+    }
+    // whatever the decoder produced, from here on it is rgba bytes
+    SDL_Surface* src = SDL_ConvertSurface(icon,scaled->format,SDL_SWSURFACE);
+    if (src==NULL) {
+        SDL_FreeSurface(scaled);
+        return NULL;
+    }
+    int sw = src->w, sh = src->h;
+
+    vector<Span> xspans, yspans;
+    vector<Uint16> xweights, yweights;
+    compute_spans(sw,dw,&xspans,&xweights);
+    compute_spans(sh,dh,&yspans,&yweights);
+
+    // premultiply once per source pixel
+    vector<Uint8> premultiplied(sw*4);
+    vector<Uint16> rows(sh*dw*4);
+    for (int y=0; y<sh; y++) {
+        const Uint8* s = (const Uint8*)src->pixels+y*src->pitch;
+        Uint8* p = &premultiplied[0];
+        for (int x=0; x<sw; x++, s+=4, p+=4) {
+            int a = s[3];
+            p[0] = div255(s[0]*a);
+            p[1] = div255(s[1]*a);
+            p[2] = div255(s[2]*a);
+            p[3] = a;
+        }
+        scale_row(&premultiplied[0],&rows[y*dw*4],xspans,xweights);
+    }
+    SDL_FreeSurface(src);
+
+    vector<Uint32> acc(dw*4);
+    for (int y=0; y<dh; y++) {
+        const Span& span = yspans[y];
+        acc.assign(dw*4,0);
+        for (int i=0; i<span.count; i++) {
+            accumulate_row(&acc[0],&rows[(span.first+i)*dw*4],dw*4,yweights[span.offset+i]);
+        }
+
+        Uint8* d = (Uint8*)scaled->pixels+y*scaled->pitch;
+        const Uint32* a = &acc[0];
+        for (int x=0; x<dw; x++, d+=4, a+=4) {
+            const Uint32 half = WEIGHTONE*WEIGHTONE/2;
+            int alpha = (a[3]+half)>>(WEIGHTBITS*2);
+            if (alpha==0) {
+                d[0] = d[1] = d[2] = d[3] = 0;
+                continue;
+            }
+            for (int c=0; c<3; c++) {
+                int v = (int((a[c]+half)>>(WEIGHTBITS*2))*255+alpha/2)/alpha;
+                d[c] = Uint8(v<255 ? v : 255);
+            }
+            d[3] = Uint8(alpha);
+        }
+    }
+    return scaled;
+}
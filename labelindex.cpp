@@ -0,0 +1,144 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "labelindex.h"
+#include <ctype.h>
+
+using namespace std;
+
+#define MAXGRAMLENGTH 3
+
+
+static char lower( char c )
+{
+    return (c&0x80) ? c : tolower(c);
+}
+
+void LabelIndex::build( const vector<string>& labels )
+{
+    m_labels.resize(labels.size());
+    m_grams.clear();
+    m_all.resize(labels.size());
+
+    for (int id=0,n=labels.size(); id<n; id++) {
+        string& label = m_labels[id];
+        label = labels[id];
+        for (size_t i=0; i<label.size(); i++) {
+            label[i] = lower(label[i]);
+        }
+        m_all[id] = id;
+
+        for (int i=0,l=label.size(); i<l; i++) {
+            for (int g=1; g<=MAXGRAMLENGTH && i+g<=l; g++) {
+                vector<int>& ids = m_grams[gram_key(&label[i],g)];
+                // ids grow in order, a repeated sequence within one label is stored once
+                if (ids.empty() || ids.back()!=id) {
+                    ids.push_back(id);
+                }
+            }
+        }
+    }
+
+    string query = m_query;
+    clear_query();
+    for (size_t i=0; i<query.size(); i++) {
+        push(query[i]);
+    }
+}
+
+void LabelIndex::push( char c )
+{
+    m_query += lower(c);
+    int length = m_query.size();
+
+    vector<int> matches;
+    if (length<=MAXGRAMLENGTH) {
+        const vector<int>* ids = find_gram(m_query.c_str(),length);
+        if (ids) {
+            matches = *ids;
+        }
+    } else {
+        // the previous matches hold the query minus its last character, keep the ones that
+        // also hold its last three characters and check those for the whole query
+        const vector<int>& previous = m_matches.back();
+        const vector<int>* ids = find_gram(m_query.c_str()+length-MAXGRAMLENGTH,MAXGRAMLENGTH);
+        if (ids) {
+            vector<int>::const_iterator a = previous.begin(), b = ids->begin();
+            while (a!=previous.end() && b!=ids->end()) {
+                if (*a<*b) {
+                    ++a;
+                } else if (*b<*a) {
+                    ++b;
+                } else {
+                    if (m_labels[*a].find(m_query)!=string::npos) {
+                        matches.push_back(*a);
+                    }
+                    ++a;
+                    ++b;
+                }
+            }
+        }
+    }
+    m_matches.push_back(matches);
+}
+
+void LabelIndex::pop()
+{
+    if (m_query.empty()) {
+        return;
+    }
+    m_query.erase(m_query.size()-1);
+    m_matches.pop_back();
+}
+
+void LabelIndex::clear_query()
+{
+    m_query.clear();
+    m_matches.clear();
+}
+
+const vector<int>& LabelIndex::get_matches() const
+{
+    return m_matches.empty() ? m_all : m_matches.back();
+}
+
+Uint32 LabelIndex::gram_key( const char* s, int length )
+{
+    Uint32 key = length<<24;
+    for (int i=0; i<length; i++) {
+        key |= Uint32((unsigned char)s[i])<<(i*8);
+    }
+    return key;
+}
+
+const vector<int>* LabelIndex::find_gram( const char* s, int length ) const
+{
+    tr1::unordered_map< Uint32,vector<int> >::const_iterator it = m_grams.find(gram_key(s,length));
+    return it!=m_grams.end() ? &it->second : NULL;
+}
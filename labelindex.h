@@ -0,0 +1,73 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef LABELINDEX_H
+#define LABELINDEX_H
+
+#include <SDL.h>
+#include <string>
+#include <vector>
+#include <tr1/unordered_map>
+
+
+/// case insensitive substring search over the widget labels for type-to-filter. every 1, 2
+/// and 3 character sequence of every label maps to the sorted ids of the labels holding it.
+/// a query of up to three characters is a single lookup, every further character only
+/// narrows the previous matches with one more list, so typing never rescans all labels
+class LabelIndex
+{
+public:
+    /// ids are the positions in labels, the current query is kept and evaluated again
+    void build( const std::vector<std::string>& labels );
+
+    /// extends the query by one character and narrows the matches
+    void push( char c );
+    /// drops the last character, the previous matches come back from the stack
+    void pop();
+    void clear_query();
+
+    const std::string& get_query() const { return m_query; }
+    bool is_filtering() const { return !m_query.empty(); }
+
+    /// ids of the labels containing the query in ascending order, every id while there is no query
+    const std::vector<int>& get_matches() const;
+
+protected:
+    static Uint32 gram_key( const char* s, int length );
+    const std::vector<int>* find_gram( const char* s, int length ) const;
+
+private:
+    std::vector<std::string> m_labels;   // lower case
+    std::tr1::unordered_map< Uint32,std::vector<int> > m_grams;
+    std::vector<int> m_all;
+    std::string m_query;
+    std::vector< std::vector<int> > m_matches;   // one entry per query character
+};
+
+#endif
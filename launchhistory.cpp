@@ -0,0 +1,176 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "launchhistory.h"
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+#define HISTORYVERSION   2
+#define HISTORYHALFLIFE  8.0    // launches of other apks until a launch counts half
+
+
+static bool write_string( FILE* fp, const string& str )
+{
+    int l = str.size();
+    return fwrite(&l,sizeof(int),1,fp)==1 && (l==0 || fwrite(str.c_str(),sizeof(char)*l,1,fp)==1);
+}
+
+static bool read_string( FILE* fp, string& str )
+{
+    int l=0;
+    if (fread(&l,sizeof(int),1,fp)!=1 || l<0 || l>PATH_MAX) {
+        return false;
+    }
+    str.resize(l);
+    return l==0 || fread(&str[0],sizeof(char)*l,1,fp)==1;
+}
+
+LaunchHistory::LaunchHistory() :
+    m_launches(0)
+{
+}
+
+bool LaunchHistory::load( const char* filename )
+{
+    m_entries.clear();
+    m_launches = 0;
+
+    FILE* fp = fopen(filename,"rb");
+    if (!fp) {
+        return false;
+    }
+    int version = 0;
+    bool ok = fread(&version,sizeof(int),1,fp)==1 && load_entries(fp,version);
+    fclose(fp);
+
+    if (!ok) {
+        // truncated or unknown, start over
+        m_entries.clear();
+        m_launches = 0;
+    }
+    return ok;
+}
+
+bool LaunchHistory::load_entries( FILE* fp, int version )
+{
+    if (version==1) {
+        // just the last apk
+        string apk;
+        if (!read_string(fp,apk)) {
+            return false;
+        }
+        if (apk.size()) {
+            record(apk);
+        }
+        return true;
+    }
+    if (version!=HISTORYVERSION) {
+        return false;
+    }
+
+    int count = 0;
+    if (fread(&m_launches,sizeof(int),1,fp)!=1 || fread(&count,sizeof(int),1,fp)!=1) {
+        return false;
+    }
+    for (int i=0; i<count; i++) {
+        string apk;
+        Entry e;
+        if (!read_string(fp,apk) || fread(&e.count,sizeof(int),1,fp)!=1 || fread(&e.last,sizeof(int),1,fp)!=1) {
+            return false;
+        }
+        m_entries[apk] = e;
+    }
+    return true;
+}
+
+bool LaunchHistory::save( const char* filename ) const
+{
+    string tmpname = string(filename)+".tmp";
+    FILE* fp = fopen(tmpname.c_str(),"wb");
+    if (!fp) {
+        return false;
+    }
+
+    int version = HISTORYVERSION;
+    int count = m_entries.size();
+    bool ok = fwrite(&version,sizeof(int),1,fp)==1
+           && fwrite(&m_launches,sizeof(int),1,fp)==1
+           && fwrite(&count,sizeof(int),1,fp)==1;
+    for (map<string,Entry>::const_iterator it=m_entries.begin(); ok && it!=m_entries.end(); ++it) {
+        ok = write_string(fp,it->first)
+          && fwrite(&it->second.count,sizeof(int),1,fp)==1
+          && fwrite(&it->second.last,sizeof(int),1,fp)==1;
+    }
+    // the data has to be on disk before the rename makes it the history
+    ok = fflush(fp)==0 && ok;
+    ok = fsync(fileno(fp))==0 && ok;
+    ok = fclose(fp)==0 && ok;
+
+    if (!ok || rename(tmpname.c_str(),filename)!=0) {
+        unlink(tmpname.c_str());
+        return false;
+    }
+    return true;
+}
+
+void LaunchHistory::record( const string& apk )
+{
+    Entry& e = m_entries.insert(make_pair(apk,Entry())).first->second;   // zeroed if new
+    e.count ++;
+    e.last = ++m_launches;
+}
+
+string LaunchHistory::get_last() const
+{
+    for (map<string,Entry>::const_iterator it=m_entries.begin(); it!=m_entries.end(); ++it) {
+        if (it->second.last==m_launches) {
+            return it->first;
+        }
+    }
+    return "";
+}
+
+void LaunchHistory::rank( vector<string>* apks, int max ) const
+{
+    vector< pair<double,string> > scored;
+    for (map<string,Entry>::const_iterator it=m_entries.begin(); it!=m_entries.end(); ++it) {
+        double age = m_launches-it->second.last;
+        scored.push_back(make_pair(-it->second.count*pow(0.5,age/HISTORYHALFLIFE),it->first));
+    }
+    sort(scored.begin(),scored.end());
+
+    apks->clear();
+    for (int i=0,n=scored.size(); i<n && i<max; i++) {
+        apks->push_back(scored[i].second);
+    }
+}
@@ -0,0 +1,73 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef LAUNCHHISTORY_H
+#define LAUNCHHISTORY_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+
+
+/// how often and how recently each apk was launched. stored versioned, and saved through a
+/// temporary file and a rename, so a crash or power loss leaves either the old or the new file
+class LaunchHistory
+{
+public:
+    LaunchHistory();
+
+    /// also takes the single last apk a version 1 file remembered
+    bool load( const char* filename );
+    bool save( const char* filename ) const;
+
+    void record( const std::string& apk );
+
+    /// the apk launched last, empty if none
+    std::string get_last() const;
+
+    /// the apks most likely launched next, best first: launch counts fading with every
+    /// launch of something else, so a new favourite overtakes an old one quickly
+    void rank( std::vector<std::string>* apks, int max ) const;
+
+protected:
+    struct Entry
+    {
+        int count;
+        int last;   // launch number of the latest launch
+    };
+
+    bool load_entries( FILE* fp, int version );
+
+private:
+    std::map<std::string,Entry> m_entries;
+    int m_launches;
+};
+
+#endif
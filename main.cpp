@@ -28,9 +28,9 @@
  **/
 
 #include <cstdlib>
+#include <cassert>
 #include <SDL.h>
 #include <SDL/SDL_image.h>
-#include <SDL/SDL_rotozoom.h>
 #include <SDL/SDL_gfxPrimitives.h>
 #include <SDL/SDL_ttf.h>
 #include <vector>
@@ -41,6 +41,24 @@
 #include <sys/stat.h>
 #include <strings.h>
 #include <iostream>
+#include <map>
+#include <list>
+#include <tr1/unordered_map>
+#include "workerpool.h"
+#include "iconatlas.h"
+#include "blend.h"
+#include "dirtyrects.h"
+#include "glyphcache.h"
+#include "apkhandlepool.h"
+#include "deferredwriter.h"
+#include "folderwatcher.h"
+#include "profiler.h"
+#include "apklauncher.h"
+#include "animation.h"
+#include "labelindex.h"
+#include "launchhistory.h"
+#include "readahead.h"
+#include "iconscaler.h"
 
 
 #define SCREENWIDTH       800
@@ -61,11 +79,27 @@
 #define ICONMAXHEIGHT     72
 #define WIDGETWIDTH       100
 #define WIDGETHEIGHT      100
+#define ATLASPAGESIZE     512
+#define PREFETCHROWS      1
 #define FONTCOLOR         200,200,200,0
 #define BACKGROUNDCOLOR   100,100,100,0
 #define SELECTIONCOLOR    150,150,150,255
+#define PLACEHOLDERCOLOR  120,120,120,255
 #define CONFIGFILE        "apkenvui.cfg"
-#define CONFIGFILEVERSION 1
+#define INDEXFILE         "apkenvui.idx"
+#define INDEXFILEVERSION  1
+#define ICONIDEXT         ".id"
+#define ICONIDVERSION     1
+#define APKHASHBYTES      65536
+#define APKHANDLEPOOLSIZE 4
+#define CACHEWRITEDELAY   250
+#define FRAMEINTERVAL     16
+#define SCROLLDURATION    160
+#define SELECTIONDURATION 96
+#define FOLDERSETTLEDELAY 500
+#define READAHEADAPKS     2
+#define READAHEADMAXBYTES (64<<20)
+#define SURFACEBUDGET     (4<<20)
 
 #ifdef PANDORA
 #define SDL_VIDEOMODE (SDL_SWSURFACE|SDL_FULLSCREEN|SDL_DOUBLEBUF)
@@ -76,13 +110,17 @@
 #define APKFOLDER "./apks"
 #define ICONCACHEFOLDER "./iconcache"
 #define RUNAPK "./runapk.sh"
+#define APKENV "./apkenv"
+#define APKENVLOG "log.txt"
+
+// SDL_USEREVENT codes
+#define EVENT_ICONSREADY 1
+#define EVENT_FOLDERCHANGED 2
 
 
 extern "C"
 {
 
-#include "../apkenv/apklib/apklib.h"
-
 void recursive_mkdir(const char *directory)
 {
     char *tmp = strdup(directory);
@@ -104,6 +142,18 @@ void recursive_mkdir(const char *directory)
     free(tmp);
 }
 
+/* apklib has no counterpart to apk_read_resources, entries, keys and values are malloc'ed there */
+void free_resource_strings(struct ResourceStrings *rs)
+{
+    int i;
+    for (i=0; i<rs->count; i++) {
+        free(rs->entries[i].key);
+        free(rs->entries[i].value);
+    }
+    free(rs->entries);
+    memset(rs,0,sizeof(*rs));
+}
+
 }
 
 using namespace std;
@@ -132,6 +182,106 @@ bool file_exists( const string& file )
     return stat(file.c_str(),&st)>=0;
 }
 
+/// identifies the apk an icon was extracted from, stored as <icon>.png.id next to the cached icon.
+/// the hash only covers the last APKHASHBYTES (64KB) of the apk, where the zip central directory
+/// with every entry's crc sits. an apk rewritten with the same size and a directory that ends up
+/// byte identical would pass as unchanged
+struct ApkIdentity
+{
+    long long size;
+    long long mtime;
+    Uint32 hash;
+};
+
+/// fnv-1a over the tail of the file, the zip central directory lives there and carries every entry's crc.
+/// hashed receives the stat of the file actually read, it is zeroed if the file could not be opened
+Uint32 apk_content_hash( const string& file, long long size, struct stat* hashed=NULL )
+{
+    Uint32 hash = 2166136261u;
+    FILE* fp = fopen(file.c_str(),"rb");
+    if (hashed && (fp==NULL || fstat(fileno(fp),hashed)!=0)) {
+        memset(hashed,0,sizeof(*hashed));
+    }
+    if (fp) {
+        if (size>APKHASHBYTES) {
+            fseek(fp,long(size-APKHASHBYTES),SEEK_SET);
+        }
+        unsigned char buf[4096];
+        size_t n;
+        while ((n=fread(buf,1,sizeof(buf),fp))>0) {
+            for (size_t i=0; i<n; i++) {
+                hash = (hash^buf[i])*16777619u;
+            }
+            Profiler::add_count("bytes_read",n);
+        }
+        fclose(fp);
+    }
+    return hash;
+}
+
+bool read_identity( const string& file, ApkIdentity* id )
+{
+    FILE* fp = fopen(file.c_str(),"rb");
+    if (!fp) {
+        return false;
+    }
+    int version=0;
+    bool ok = fread(&version,sizeof(int),1,fp)==1 && version==ICONIDVERSION
+           && fread(&id->size,sizeof(id->size),1,fp)==1
+           && fread(&id->mtime,sizeof(id->mtime),1,fp)==1
+           && fread(&id->hash,sizeof(id->hash),1,fp)==1;
+    fclose(fp);
+    return ok;
+}
+
+/// the identity file contents in a malloc'ed buffer, same layout read_identity expects
+char* encode_identity( const ApkIdentity& id, size_t* size )
+{
+    int version = ICONIDVERSION;
+    *size = sizeof(version)+sizeof(id.size)+sizeof(id.mtime)+sizeof(id.hash);
+    char* buf = (char*)malloc(*size);
+    char* p = buf;
+    memcpy(p,&version,sizeof(version)); p += sizeof(version);
+    memcpy(p,&id.size,sizeof(id.size)); p += sizeof(id.size);
+    memcpy(p,&id.mtime,sizeof(id.mtime)); p += sizeof(id.mtime);
+    memcpy(p,&id.hash,sizeof(id.hash));
+    return buf;
+}
+
+void write_identity( const string& file, const ApkIdentity& id )
+{
+    FILE* fp = fopen(file.c_str(),"wb");
+    if (fp) {
+        size_t size;
+        char* buf = encode_identity(id,&size);
+        fwrite(buf,size,1,fp);
+        free(buf);
+        fclose(fp);
+    }
+}
+
+/// converts a static asset to the screen format once, so blits need no per-pixel conversion
+SDL_Surface* display_format( SDL_Surface* surface, bool alpha )
+{
+    if (surface==NULL || SDL_GetVideoSurface()==NULL) {
+        return surface;
+    }
+    SDL_Surface* converted = alpha ? SDL_DisplayFormatAlpha(surface) : SDL_DisplayFormat(surface);
+    if (converted==NULL) {
+        return surface;
+    }
+    SDL_FreeSurface(surface);
+    return converted;
+}
+
+/// alpha blended 32 bit sources go through the vector blend path, everything else through SDL
+void blit_surface( SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst, SDL_Rect* dstrect )
+{
+    if (!blend_blit(src,srcrect,dst,dstrect)) {
+        SDL_BlitSurface(src,srcrect,dst,dstrect);
+    }
+}
+
 /* -------- */
 
 class Widget
@@ -139,19 +289,22 @@ class Widget
 public:
     Widget() :
         m_icon(NULL),
+        m_icon_shared(false),
+        m_icon_atlas(NULL),
         m_text(NULL),
         m_row(-1),
         m_col(-1),
         m_selected(0)
     {
         memset(&m_icon_rect,0,sizeof(m_icon_rect));
+        memset(&m_icon_src,0,sizeof(m_icon_src));
         memset(&m_text_rect,0,sizeof(m_text_rect));
         memset(&m_full_rect,0,sizeof(m_full_rect));
     }
 
     virtual ~Widget()
     {
-        if (m_icon) SDL_FreeSurface(m_icon);
+        release_icon();
         if (m_text) SDL_FreeSurface(m_text);
     }
 
@@ -177,21 +330,93 @@ public:
 
     bool load_icon_surface(const string& iconpath, int maxwidth, int maxheight)
     {
-        if (file_exists(iconpath) && m_icon==NULL) {
-            m_icon = IMG_Load(iconpath.c_str());
-
-            if ((maxwidth>0 && maxheight>0) && m_icon!=NULL && (m_icon->w>maxwidth || m_icon->h>maxheight))
-            {
-                resize_icon(maxwidth,maxheight);
-            }
+        if (m_icon==NULL) {
+            set_icon_surface(decode_icon(iconpath,maxwidth,maxheight));
         }
         return m_icon!=NULL;
     }
 
+    /// loads and downsizes an icon, touches no widget state so it is safe to call from worker threads
+    static SDL_Surface* decode_icon(const string& iconpath, int maxwidth, int maxheight)
+    {
+        if (!file_exists(iconpath)) {
+            return NULL;
+        }
+        SDL_Surface* icon;
+        {
+            ProfileScope profile("img_load");
+            icon = IMG_Load(iconpath.c_str());
+        }
+        return fit_icon(icon,maxwidth,maxheight);
+    }
+
+    /// same as decode_icon for an image already in memory
+    static SDL_Surface* decode_icon(const char* buf, size_t size, int maxwidth, int maxheight)
+    {
+        SDL_RWops* rw = SDL_RWFromConstMem(buf,size);
+        if (rw==NULL) {
+            return NULL;
+        }
+        SDL_Surface* icon;
+        {
+            ProfileScope profile("img_load");
+            icon = IMG_Load_RW(rw,1);
+        }
+        return fit_icon(icon,maxwidth,maxheight);
+    }
+
+    /// replaces the current icon and re-aligns the widget, a shared surface is not freed by the widget
+    void set_icon_surface(SDL_Surface* icon, bool shared=false)
+    {
+        release_icon();
+        m_icon = icon;
+        m_icon_shared = shared;
+        if (icon) {
+            SDL_Rect src = {0,0,Uint16(icon->w),Uint16(icon->h)};
+            m_icon_src = src;
+        }
+        set_rect(m_full_rect);
+        align_rect();
+    }
+
+    /// the icon lives in a cell of the atlas, the cell is handed back when the icon is replaced
+    void set_icon_from_atlas(IconAtlas* atlas, SDL_Surface* page, const SDL_Rect& rect)
+    {
+        release_icon();
+        m_icon = page;
+        m_icon_shared = true;
+        m_icon_atlas = atlas;
+        m_icon_src = rect;
+        set_rect(m_full_rect);
+        align_rect();
+    }
+
+    bool has_own_icon() const
+    {
+        return m_icon!=NULL && (!m_icon_shared || m_icon_atlas!=NULL);
+    }
+
     void set_text(const string& text, TTF_Font* font)
     {
+        ProfileScope profile("render_text");
         SDL_Color clr = {FONTCOLOR};
-        m_text = TTF_RenderText_Blended(font,text.c_str(),clr);
+        if (m_text) SDL_FreeSurface(m_text);
+        m_text = display_format(GlyphCache::get(font,clr)->render(text.c_str()),true);
+        set_rect(m_full_rect);
+        align_rect();
+    }
+
+    bool has_text() const
+    {
+        return m_text!=NULL;
+    }
+
+    /// drops icon and text surfaces, e.g. once the widget scrolled out of view
+    void release_surfaces()
+    {
+        release_icon();
+        if (m_text) SDL_FreeSurface(m_text);
+        m_text = NULL;
     }
 
     SDL_Surface* get_icon_surface() const
@@ -199,6 +424,30 @@ public:
         return m_icon;
     }
 
+    /// pixel memory held by the widget's own surfaces, a shared icon is not counted
+    size_t get_surface_bytes() const
+    {
+        size_t bytes = 0;
+        if (m_text) {
+            bytes += m_text->pitch*m_text->h;
+        }
+        if (m_icon_atlas) {
+            bytes += m_icon_src.w*m_icon_src.h*m_icon->format->BytesPerPixel;
+        } else if (m_icon && !m_icon_shared) {
+            bytes += m_icon->pitch*m_icon->h;
+        }
+        return bytes;
+    }
+
+    /// converts the widget's own surfaces to the screen format
+    void convert_to_display_format()
+    {
+        if (m_icon && !m_icon_shared) {
+            set_icon_surface(display_format(m_icon,true));
+        }
+        m_text = display_format(m_text,true);
+    }
+
     /** icon rect **/
 
     void set_rect( const SDL_Rect& rect )
@@ -211,8 +460,10 @@ public:
     void align_rect()
     {
         if(m_icon!=NULL) {
-            m_icon_rect.x = m_icon_rect.x + (m_icon_rect.w-m_icon->w)/2;
+            m_icon_rect.x = m_icon_rect.x + (m_icon_rect.w-m_icon_src.w)/2;
             m_icon_rect.y += ICONOFFSET;
+            m_icon_rect.w = m_icon_src.w;
+            m_icon_rect.h = m_icon_src.h;
         }
         if (m_text!=NULL) {
             m_text_rect.x = m_text_rect.x + (m_text_rect.w-m_text->w)/2;
@@ -220,25 +471,52 @@ public:
         }
     }
 
-    void blit_to(SDL_Surface* selection, SDL_Surface* target)
+    /// dy shifts the widget vertically, e.g. while the grid slides
+    void blit_to(SDL_Surface* selection, SDL_Surface* target, int dy=0)
     {
+        // stay within the area the caller is redrawing
+        SDL_Rect area = target->clip_rect;
         SDL_Rect cliprect = m_full_rect;
         cliprect.x += CLIPBORDER;
+        cliprect.y += dy;
         cliprect.w -= CLIPBORDER*2;
+        if (!intersect_rect(cliprect,area,&cliprect)) {
+            cliprect.w = cliprect.h = 0;
+        }
 
         if (m_selected && selection) {
             SDL_Rect selectionrect = m_full_rect;
-            SDL_BlitSurface(selection,NULL,target,&selectionrect);
+            selectionrect.y += dy;
+            blit_surface(selection,NULL,target,&selectionrect);
         }
 
         SDL_SetClipRect(target,&cliprect);
         if (m_icon) {
-            SDL_BlitSurface(m_icon,NULL,target,&m_icon_rect);
+            SDL_Rect iconsrc = m_icon_src;
+            SDL_Rect iconrect = m_icon_rect;
+            iconrect.y += dy;
+            blit_surface(m_icon,&iconsrc,target,&iconrect);
         }
         if (m_text) {
-            SDL_BlitSurface(m_text,NULL,target,&m_text_rect);
+            SDL_Rect textrect = m_text_rect;
+            textrect.y += dy;
+            blit_surface(m_text,NULL,target,&textrect);
+        }
+        SDL_SetClipRect(target,&area);
+    }
+
+    /// draws just the selection frame, for targets that already hold the widget itself
+    void blit_selection_to(SDL_Surface* selection, SDL_Surface* target)
+    {
+        if (m_selected && selection) {
+            SDL_Rect selectionrect = m_full_rect;
+            blit_surface(selection,NULL,target,&selectionrect);
         }
-        SDL_SetClipRect(target,NULL);
+    }
+
+    const SDL_Rect& get_rect() const
+    {
+        return m_full_rect;
     }
 
 
@@ -259,19 +537,42 @@ public:
     }
 
 protected:
-    void resize_icon(int maxwidth, int maxheight)
+    static SDL_Surface* fit_icon(SDL_Surface* icon, int maxwidth, int maxheight)
+    {
+        if ((maxwidth>0 && maxheight>0) && icon!=NULL && (icon->w>maxwidth || icon->h>maxheight))
+        {
+            icon = resize_icon(icon,maxwidth,maxheight);
+        }
+        return icon;
+    }
+
+    void release_icon()
+    {
+        if (m_icon_atlas) {
+            m_icon_atlas->remove(m_icon,m_icon_src);
+        } else if (m_icon && !m_icon_shared) {
+            SDL_FreeSurface(m_icon);
+        }
+        m_icon = NULL;
+        m_icon_shared = false;
+        m_icon_atlas = NULL;
+    }
+
+    static SDL_Surface* resize_icon(SDL_Surface* icon, int maxwidth, int maxheight)
     {
-        float aspect = float(maxwidth)/float(maxheight);
-        SDL_Surface *scaled =
-            zoomSurface(m_icon,float(maxwidth)/float(m_icon->w), float(maxheight)/float(m_icon->h)*aspect,SMOOTHING_ON);
-        SDL_FreeSurface(m_icon);
-        m_icon = scaled;
+        ProfileScope profile("scale_icon");
+        SDL_Surface *scaled = scale_icon(icon,maxwidth,maxheight);
+        SDL_FreeSurface(icon);
+        return scaled;
     }
 
 private:
     SDL_Rect m_full_rect;
     SDL_Rect m_icon_rect;
     SDL_Surface *m_icon;
+    SDL_Rect m_icon_src;
+    bool m_icon_shared;
+    IconAtlas* m_icon_atlas;
     SDL_Rect m_text_rect;
     SDL_Surface *m_text;
     int m_row;
@@ -280,44 +581,158 @@ private:
 };
 
 
-/* -------- */
+/** resource index **/
 
-class ApkWidget : public Widget
+/// one pass index over an apk's ResourceStrings, keyed by resource key. keys may occur
+/// more than once, so the values are also kept grouped by drawable density
+class ResourceIndex
 {
 public:
-    static ApkWidget* S_CurrentApk;
-    static void extract_icon_exact_callback(const char* filename, char* buf, size_t size)
+    enum {
+        DENSITY_HDPI,
+        DENSITY_MDPI,
+        DENSITY_LDPI,
+        DENSITY_ANY,
+        DENSITY_COUNT
+    };
+
+    /// hires first, "res/drawable" matches every drawable folder
+    static const char* S_DensityPrefixes[DENSITY_COUNT];
+
+    void build( const struct ResourceStrings& rs )
     {
-        FILE *fp = fopen(S_CurrentApk->m_apk_iconpath.c_str(),"wb");
-        if (fp)
-        {
-            fwrite(buf,size,1,fp);
-            fclose(fp);
+        clear();
+        m_app_name = rs.app_name ? rs.app_name : "";
+        m_game_name = rs.game_name ? rs.game_name : "";
+
+        for (int i=0; i<rs.count; i++) {
+            const char* key = rs.entries[i].key;
+            const char* value = rs.entries[i].value;
+
+            Values& values = m_entries[key];
+            if (values.all.empty()) {
+                m_keys.push_back(key);
+            }
+            values.all.push_back(value);
+
+            // first value per density wins, same as the old linear scan
+            for (int d=0; d<DENSITY_COUNT; d++) {
+                if (values.density[d]<0 && strncmp(value,S_DensityPrefixes[d],strlen(S_DensityPrefixes[d]))==0) {
+                    values.density[d] = values.all.size()-1;
+                }
+            }
         }
     }
 
-    ApkWidget( const string& folder, const string& name )
+    void clear()
     {
-        m_apk_basename = name;
-        m_apk_filepath = folder+"/"+name;
-        m_apk_iconpath = my_realpath(ICONCACHEFOLDER) + "/" + name + ".png";
-        m_apk = apk_open(m_apk_filepath.c_str());
+        m_entries.clear();
+        m_keys.clear();
+        m_app_name.clear();
+        m_game_name.clear();
+    }
+
+    const char* get( const char* key, const char* default_value ) const
+    {
+        const Values* values = find(key);
+        return values ? values->all[0].c_str() : default_value;
+    }
+
+    const char* get( const char* key, int density, const char* default_value ) const
+    {
+        const Values* values = find(key);
+        return values && values->density[density]>=0 ? values->all[values->density[density]].c_str() : default_value;
+    }
+
+    const string& get_app_name() const { return m_app_name; }
+    const string& get_game_name() const { return m_game_name; }
+
+    /// all values of key_match, or everything for an empty key
+    void print( const char* key_match ) const
+    {
+        for (int k=0,nk=m_keys.size(); k<nk; k++) {
+            if (key_match[0]==0 || m_keys[k]==key_match) {
+                const Values* values = find(m_keys[k].c_str());
+                for (int i=0,n=values->all.size(); i<n; i++) {
+                    cout << m_keys[k] << " -> " << values->all[i] << endl;
+                }
+            }
+        }
+    }
 
-        if (apk_read_resources(m_apk,&m_apk_resources)==APK_OK)
+protected:
+    struct Values
+    {
+        Values()
         {
-            if (m_apk_resources.app_name!=NULL) {
-                m_apk_basename = m_apk_resources.app_name;
+            for (int d=0; d<DENSITY_COUNT; d++) density[d] = -1;
+        }
+        vector<string> all;
+        int density[DENSITY_COUNT];   // index into all or -1
+    };
+
+    const Values* find( const char* key ) const
+    {
+        tr1::unordered_map<string,Values>::const_iterator it = m_entries.find(key);
+        return it!=m_entries.end() ? &it->second : NULL;
+    }
+
+private:
+    tr1::unordered_map<string,Values> m_entries;
+    vector<string> m_keys;   // in table order
+    string m_app_name;
+    string m_game_name;
+};
+const char* ResourceIndex::S_DensityPrefixes[DENSITY_COUNT] = {
+    "res/drawable-hdpi",
+    "res/drawable-mdpi",
+    "res/drawable-ldpi",
+    "res/drawable"
+};
+
+
+/* -------- */
+
+class SurfaceCache;
+
+class ApkWidget : public Widget
+{
+public:
+    static ApkHandlePool* S_HandlePool;
+    static DeferredWriter* S_CacheWriter;
+    static SurfaceCache* S_SurfaceCache;
+
+    /// reads name and icon candidates from the open handle apk, which stays with the caller.
+    /// the resource table does not outlive the constructor
+    ApkWidget( const string& folder, const string& name, AndroidApk* apk )
+    {
+        init(folder,name);
+
+        if (read_resources(apk)) {
+            if (m_resources.get_app_name().size()) {
+                m_apk_basename = m_resources.get_app_name();
             }
-            if (m_apk_resources.game_name!=NULL) {
-                m_apk_basename = m_apk_resources.game_name;
+            if (m_resources.get_game_name().size()) {
+                m_apk_basename = m_resources.get_game_name();
             }
+            free_resources();
+        }
+
+        if (m_icon_candidates.size()) {
+            m_apk_iconentry = m_icon_candidates[0];
         }
     }
 
+    /// restore from the apk index, the apk itself is only opened if the icon has to be extracted
+    ApkWidget( const string& folder, const string& name, const string& basename, const string& iconentry )
+    {
+        init(folder,name);
+        m_apk_basename = basename;
+        m_apk_iconentry = iconentry;
+    }
+
     ~ApkWidget()
     {
-        if (m_apk)
-            apk_close(m_apk);
     }
 
     string get_apk_filename() const
@@ -330,52 +745,143 @@ public:
         return m_apk_basename;
     }
 
-    AndroidApk* get_apk() const
+    /// the text shown below the icon
+    void set_label( const string& label )
+    {
+        m_label = label;
+    }
+    const string& get_label() const
     {
-        return m_apk;
+        return m_label;
     }
 
+    /** residency, only widgets near the viewport hold surfaces **/
 
-    /** apk icon **/
+    void set_resident( bool resident )
+    {
+        m_resident = resident;
+    }
+    bool is_resident() const
+    {
+        return m_resident;
+    }
 
-    void extract_icon()
+    void set_icon_pending( bool pending )
     {
-        // The code below may look a bit over-complicated but there's a reason:
-        // The resource table stores a key->value mapping where the key is allowed to exist more than once,
-        // so i look out for hires icons first and then go down to the lowres ones.
-        // Also there's either "app_icon" or "icon" used as a key name ...
-        if (!icon_exists()) {
-            const char* icon_prefixes[] = {
-                "res/drawable-hdpi",
-                "res/drawable-mdpi",
-                "res/drawable-ldpi",
-                "res/drawable",
-                0
-            };
+        m_icon_pending = pending;
+    }
+    bool is_icon_pending() const
+    {
+        return m_icon_pending;
+    }
 
-            S_CurrentApk = this;
+    /// the apk has no icon that decodes, it is not asked for again. a changed file gets a new widget
+    void set_icon_failed( bool failed )
+    {
+        m_icon_failed = failed;
+    }
+    bool is_icon_failed() const
+    {
+        return m_icon_failed;
+    }
 
-            int i=0;
-            while(!icon_exists() && icon_prefixes[i]) {
-                const char* icon_path = get_resource_string("app_icon",icon_prefixes[i],"");
-                if (icon_path[0]==0) {
-                    icon_path = get_resource_string("icon",icon_prefixes[i],"");
-                }
-                if (icon_path[0]!=0) {
-                    apk_for_each_file(m_apk,icon_path,extract_icon_exact_callback);
-                }
-                i++;
-            }
+    string get_icon_entry() const
+    {
+        return m_apk_iconentry;
+    }
 
-            S_CurrentApk = NULL;
-        }
+    long long get_apk_size() const
+    {
+        return m_apk_size;
+    }
 
+    long long get_apk_mtime() const
+    {
+        return m_apk_mtime;
     }
 
 
-    bool load_icon(int maxw, int maxh)
+    /** apk icon **/
+
+    /// reads the icon straight out of the apk into a malloc'ed buffer owned by the caller
+    bool extract_icon( char** buf, size_t* size )
+    {
+        ProfileScope profile("extract_icon",false,&m_apk_filepath);
+        bool found = false;
+        AndroidApk* apk = S_HandlePool->acquire(m_apk_filepath);
+        if (apk) {
+            // the entry the index remembers ranks first, then the candidates from hdpi down,
+            // all of them are matched in the same walk over the zip directory
+            vector<string> names;
+            if (m_apk_iconentry.size()) {
+                names.push_back(m_apk_iconentry);
+            }
+            names.insert(names.end(),m_icon_candidates.begin(),m_icon_candidates.end());
+            int best = uncompress_best(apk,names,buf,size);
+
+            // restored from the index and the remembered entry is gone, only now the resource table is worth reading
+            if (best<0 && m_icon_candidates.empty() && read_resources(apk)) {
+                free_resources();
+                names = m_icon_candidates;
+                best = uncompress_best(apk,names,buf,size);
+            }
+            if (best>=0) {
+                m_apk_iconentry = names[best];
+                found = true;
+            }
+            S_HandlePool->release(apk);
+        }
+        if (found) {
+            Profiler::add_count("icons_extracted",1);
+            Profiler::add_count("bytes_read",*size);
+        }
+        return found;
+    }
+
+    /// decode without touching the widget surfaces, used by the icon workers.
+    /// the cached icon is used if it was taken from this very apk, otherwise the icon
+    /// is decoded from memory and the cache write is left to S_CacheWriter
+    SDL_Surface* decode_apk_icon(int maxw, int maxh)
     {
-        return load_icon_surface(m_apk_iconpath,maxw,maxh);
+        ProfileScope profile("decode_apk_icon",false,&m_apk_filepath);
+        if (icon_exists() && icon_valid()) {
+            Profiler::add_count("icon_cache_hits",1);
+            return decode_icon(m_apk_iconpath,maxw,maxh);
+        }
+        Profiler::add_count("icon_cache_misses",1);
+        // never fall back to a stale icon if the new apk has none
+        unlink(m_apk_iconpath.c_str());
+        unlink((m_apk_iconpath+ICONIDEXT).c_str());
+
+        char* buf = NULL;
+        size_t size = 0;
+        if (!extract_icon(&buf,&size)) {
+            return NULL;
+        }
+
+        SDL_Surface* icon = decode_icon(buf,size,maxw,maxh);
+
+        // the widget's file has to be the one hashed, a replacement during the job would pair the
+        // new file's hash with what may be the old icon. the watcher brings a new widget for it
+        ApkIdentity id;
+        bool cache = icon && S_CacheWriter;
+        if (cache) {
+            struct stat hashed;
+            id.size = m_apk_size;
+            id.mtime = m_apk_mtime;
+            id.hash = apk_content_hash(m_apk_filepath,m_apk_size,&hashed);
+            cache = same_file(hashed);
+        }
+        if (cache) {
+            size_t idsize;
+            char* idbuf = encode_identity(id,&idsize);
+            // queued in this order, so an identity never exists without its icon
+            S_CacheWriter->write(m_apk_iconpath,buf,size);
+            S_CacheWriter->write(m_apk_iconpath+ICONIDEXT,idbuf,idsize);
+        } else {
+            free(buf);
+        }
+        return icon;
     }
 
     bool icon_exists()
@@ -383,68 +889,532 @@ public:
         return file_exists(m_apk_iconpath);
     }
 
+    /// st is still the file this widget was scanned from
+    bool same_file( const struct stat& st ) const
+    {
+        return st.st_ino==m_apk_inode && st.st_size==m_apk_size && st.st_mtime==m_apk_mtime;
+    }
+
+    /// compares the apk against the identity stored with the cached icon,
+    /// the hash is only computed if size or mtime differ (e.g. the apk was copied)
+    bool icon_valid()
+    {
+        ApkIdentity id;
+        if (!read_identity(m_apk_iconpath+ICONIDEXT,&id) || id.size!=m_apk_size) {
+            return false;
+        }
+        if (id.mtime==m_apk_mtime) {
+            return true;
+        }
+        struct stat hashed;
+        if (id.hash!=apk_content_hash(m_apk_filepath,m_apk_size,&hashed) || !same_file(hashed)) {
+            return false;
+        }
+        // only the mtime changed, the refreshed identity goes out with the other cache writes
+        id.mtime = m_apk_mtime;
+        if (S_CacheWriter) {
+            size_t idsize;
+            char* idbuf = encode_identity(id,&idsize);
+            S_CacheWriter->write(m_apk_iconpath+ICONIDEXT,idbuf,idsize);
+        } else {
+            write_identity(m_apk_iconpath+ICONIDEXT,id);
+        }
+        return true;
+    }
+
 protected:
-    const char* get_resource_string( const char* key, const char* default_value )
+    void init( const string& folder, const string& name )
     {
-        for (int i=0;i<m_apk_resources.count;i++) {
-            if (strcmp(m_apk_resources.entries[i].key,key)==0) {
-                return m_apk_resources.entries[i].value;
-            }
+        m_resident = false;
+        m_icon_pending = false;
+        m_icon_failed = false;
+        m_apk_basename = name;
+        m_apk_filepath = folder+"/"+name;
+        m_apk_iconpath = my_realpath(ICONCACHEFOLDER) + "/" + name + ".png";
+
+        struct stat st;
+        if (stat(m_apk_filepath.c_str(),&st)==0) {
+            m_apk_size = st.st_size;
+            m_apk_mtime = st.st_mtime;
+            m_apk_inode = st.st_ino;
+        } else {
+            m_apk_size = m_apk_mtime = -1;
+            m_apk_inode = 0;
         }
-        return default_value;
     }
-    const char* get_resource_string( const char* key, const char* value_prefix, const char* default_value )
+
+    /// walks the zip directory once and inflates only the best ranked entry present, names[0]
+    /// ranks highest and ends the walk right away. returns the index into names or -1
+    static int uncompress_best( AndroidApk* apk, const vector<string>& names, char** buf, size_t* size )
     {
-        for (int i=0;i<m_apk_resources.count;i++) {
-            if (strcmp(m_apk_resources.entries[i].key,key)==0
-                && strstr(m_apk_resources.entries[i].value,value_prefix)==m_apk_resources.entries[i].value) {
-                return m_apk_resources.entries[i].value;
+        *buf = NULL;
+        *size = 0;
+        if (names.empty()) {
+            return -1;
+        }
+        tr1::unordered_map<string,int> ranks;
+        for (int i=0,n=names.size(); i<n; i++) {
+            ranks.insert(make_pair(names[i],i));   // a repeated name keeps its better rank
+        }
+
+        int best = -1;
+        unz_file_pos bestpos;
+        char filename[PATH_MAX];
+        unz_file_info info;
+        int walked = 0;
+        for (int r=unzGoToFirstFile(apk->zip); r==UNZ_OK && best!=0; r=unzGoToNextFile(apk->zip)) {
+            walked ++;
+            if (unzGetCurrentFileInfo(apk->zip,&info,filename,sizeof(filename),NULL,0,NULL,0)!=UNZ_OK) {
+                continue;
+            }
+            tr1::unordered_map<string,int>::const_iterator it = ranks.find(filename);
+            if (it!=ranks.end() && (best<0 || it->second<best) && unzGetFilePos(apk->zip,&bestpos)==UNZ_OK) {
+                best = it->second;
             }
         }
-        return default_value;
+        Profiler::add_count("zip_entries_walked",walked);
+
+        if (best<0 || unzGoToFilePos(apk->zip,&bestpos)!=UNZ_OK || !inflate_current(apk,buf,size)) {
+            return -1;
+        }
+        return best;
     }
 
+    /// the entry the zip directory points at into a malloc'ed buffer, fails on a bad crc
+    static bool inflate_current( AndroidApk* apk, char** buf, size_t* size )
+    {
+        unz_file_info info;
+        if (unzGetCurrentFileInfo(apk->zip,&info,NULL,0,NULL,0,NULL,0)!=UNZ_OK || unzOpenCurrentFile(apk->zip)!=UNZ_OK) {
+            return false;
+        }
+        char* data = (char*)malloc(info.uncompressed_size>0 ? info.uncompressed_size : 1);
+        int read = data ? unzReadCurrentFile(apk->zip,data,info.uncompressed_size) : -1;
+        // closing checks the crc of what was read
+        if (unzCloseCurrentFile(apk->zip)!=UNZ_OK || read<0 || (unsigned long)read!=info.uncompressed_size) {
+            free(data);
+            return false;
+        }
+        *buf = data;
+        *size = info.uncompressed_size;
+        return true;
+    }
 
-    void print_resource_strings(const char* key_match)
+    /// indexes the resource table and collects the icon candidates, pair with free_resources()
+    bool read_resources( AndroidApk* apk )
     {
-        for (int i=0,n=m_apk_resources.count; i<n; i++) {
-            if (key_match[0]==0 || strcmp(m_apk_resources.entries[i].key,key_match)==0) {
-                cout << m_apk_resources.entries[i].key << " -> " << m_apk_resources.entries[i].value << endl;
+        ProfileScope profile("apk_read_resources",false,&m_apk_filepath);
+        struct ResourceStrings rs;
+        memset(&rs,0,sizeof(rs));
+        if (apk_read_resources(apk,&rs)!=APK_OK) {
+            return false;
+        }
+        // the index keeps its own copies, the raw table can go right away
+        m_resources.build(rs);
+        free_resource_strings(&rs);
+
+        // The code below may look a bit over-complicated but there's a reason:
+        // The resource table stores a key->value mapping where the key is allowed to exist more than once,
+        // so i look out for hires icons first and then go down to the lowres ones.
+        // Also there's either "app_icon" or "icon" used as a key name ...
+        m_icon_candidates.clear();
+        for (int d=0; d<ResourceIndex::DENSITY_COUNT; d++) {
+            const char* icon_path = m_resources.get("app_icon",d,"");
+            if (icon_path[0]==0) {
+                icon_path = m_resources.get("icon",d,"");
+            }
+            if (icon_path[0]!=0) {
+                m_icon_candidates.push_back(icon_path);
             }
         }
+        return true;
+    }
+
+    /// the resource index is only needed while reading the metadata
+    void free_resources()
+    {
+        m_resources.clear();
+    }
+
+    const char* get_resource_string( const char* key, const char* default_value )
+    {
+        return m_resources.get(key,default_value);
+    }
+
+    void print_resource_strings(const char* key_match)
+    {
+        m_resources.print(key_match);
     }
 
 private:
-    AndroidApk* m_apk;
     string m_apk_filepath;
     string m_apk_iconpath;
     string m_apk_basename;
-    struct ResourceStrings m_apk_resources;
+    string m_label;
+    string m_apk_iconentry;
+    bool m_resident;
+    bool m_icon_pending;
+    bool m_icon_failed;
+    long long m_apk_size;
+    long long m_apk_mtime;
+    ino_t m_apk_inode;
+    vector<string> m_icon_candidates;
+    ResourceIndex m_resources;
 };
-ApkWidget*  ApkWidget::S_CurrentApk = 0;
+ApkHandlePool* ApkWidget::S_HandlePool = 0;
+DeferredWriter* ApkWidget::S_CacheWriter = 0;
+SurfaceCache* ApkWidget::S_SurfaceCache = 0;
 
-///
-int list_apks( const char* dir0, vector<ApkWidget*>* apks )
-{
-    string directory = my_realpath(dir0);
+/** surface cache **/
 
-    DIR* dir = opendir(directory.c_str());
-    if (!dir) {
-        cerr << "Failed to open directory: " << directory << endl;
-        return 0;
+/// keeps label and icon surfaces of widgets that left the resident rows, within a byte budget.
+/// resident widgets are pinned: they count towards the budget but are never evicted. the others
+/// go least recently shown first and get their surfaces back from the icon cache on return
+class SurfaceCache
+{
+public:
+    SurfaceCache( size_t budget ) :
+        m_budget(budget),
+        m_bytes(0),
+        m_peak_bytes(0),
+        m_hits(0),
+        m_misses(0),
+        m_evictions(0)
+    {
     }
 
+    /// the widget became resident, or its surfaces changed while it is
+    void pin( ApkWidget* apk )
+    {
+        Entry& e = entry(apk);
+        if (!e.pinned) {
+            m_lru.erase(e.lru);
+            e.pinned = true;
+        }
+        resize(e,apk->get_surface_bytes());
+    }
+
+    /// the widget left the resident rows, its surfaces stay until they are evicted.
+    /// a widget the cache does not know, e.g. one forgotten on retirement, is left alone
+    void unpin( ApkWidget* apk )
+    {
+        tr1::unordered_map<ApkWidget*,Entry>::iterator it = m_entries.find(apk);
+        if (it==m_entries.end()) {
+            return;
+        }
+        Entry& e = it->second;
+        if (e.pinned) {
+            m_lru.push_front(apk);
+            e.lru = m_lru.begin();
+            e.pinned = false;
+        }
+        resize(e,apk->get_surface_bytes());
+    }
+
+    /// frees the widget's surfaces and stops tracking it, e.g. before it is deleted
+    void forget( ApkWidget* apk )
+    {
+        apk->release_surfaces();
+        tr1::unordered_map<ApkWidget*,Entry>::iterator it = m_entries.find(apk);
+        if (it!=m_entries.end()) {
+            if (!it->second.pinned) m_lru.erase(it->second.lru);
+            m_bytes -= it->second.bytes;
+            m_entries.erase(it);
+        }
+    }
+
+    bool is_tracked( ApkWidget* apk ) const
+    {
+        return m_entries.find(apk)!=m_entries.end();
+    }
+
+    /// a widget entering the resident rows either still had its surfaces or needs them rebuilt
+    void count_lookup( bool hit )
+    {
+        if (hit) m_hits ++; else m_misses ++;
+    }
+
+    /// evicts from the least recently shown end until the budget is met
+    void trim()
+    {
+        while (m_bytes>m_budget && !m_lru.empty()) {
+            ApkWidget* apk = m_lru.back();
+            forget(apk);
+            m_evictions ++;
+        }
+    }
+
+    /// frees everything not on screen, e.g. while another app runs
+    void clear()
+    {
+        while (!m_lru.empty()) {
+            forget(m_lru.back());
+        }
+    }
+
+    size_t get_bytes() const
+    {
+        return m_bytes;
+    }
+
+    void print_stats( ostream& out ) const
+    {
+        int lookups = m_hits+m_misses;
+        out << "surface cache: " << m_bytes/1024 << "kb of " << m_budget/1024 << "kb, " << m_peak_bytes/1024 << "kb peak, "
+            << m_hits << " hits, " << m_misses << " misses";
+        if (lookups>0) {
+            out << " (" << (m_hits*100/lookups) << "% hit rate)";
+        }
+        out << ", " << m_evictions << " evictions" << endl;
+    }
+
+    void add_profile_counts() const
+    {
+        Profiler::set_count("surface_cache_bytes",m_bytes);
+        Profiler::set_count("surface_cache_peak_bytes",m_peak_bytes);
+        Profiler::set_count("surface_cache_hits",m_hits);
+        Profiler::set_count("surface_cache_misses",m_misses);
+        Profiler::set_count("surface_cache_evictions",m_evictions);
+    }
+
+protected:
+    struct Entry
+    {
+        size_t bytes;
+        bool pinned;
+        list<ApkWidget*>::iterator lru;   // only valid while not pinned
+    };
+
+    Entry& entry( ApkWidget* apk )
+    {
+        pair<tr1::unordered_map<ApkWidget*,Entry>::iterator,bool> it = m_entries.insert(make_pair(apk,Entry()));
+        if (it.second) {
+            it.first->second.bytes = 0;
+            it.first->second.pinned = true;
+        }
+        return it.first->second;
+    }
+
+    void resize( Entry& e, size_t bytes )
+    {
+        m_bytes += bytes-e.bytes;
+        e.bytes = bytes;
+        if (m_bytes>m_peak_bytes) m_peak_bytes = m_bytes;
+    }
+
+private:
+    tr1::unordered_map<ApkWidget*,Entry> m_entries;
+    list<ApkWidget*> m_lru;   // unpinned widgets, most recently shown first
+    size_t m_budget;
+    size_t m_bytes;
+    size_t m_peak_bytes;
+    int m_hits;
+    int m_misses;
+    int m_evictions;
+};
+
+/** apk index **/
+
+/// on-disk cache of the apk metadata, an entry is only valid as long as size and mtime match
+class ApkIndex
+{
+public:
+    struct Entry
+    {
+        long long size;
+        long long mtime;
+        string basename;
+        string iconentry;
+    };
+
+    const Entry* lookup( const string& path, long long size, long long mtime ) const
+    {
+        map<string,Entry>::const_iterator it = m_entries.find(path);
+        if (it!=m_entries.end() && it->second.size==size && it->second.mtime==mtime) {
+            return &it->second;
+        }
+        return NULL;
+    }
+
+    /// rebuilds the index from the current widgets, returns true if anything changed
+    bool update( const vector<ApkWidget*>& apks )
+    {
+        map<string,Entry> entries;
+        for (int i=0,n=apks.size(); i<n; i++) {
+            Entry& e = entries[apks[i]->get_apk_filename()];
+            e.size = apks[i]->get_apk_size();
+            e.mtime = apks[i]->get_apk_mtime();
+            e.basename = apks[i]->get_apk_basename();
+            e.iconentry = apks[i]->get_icon_entry();
+        }
+        bool changed = entries.size()!=m_entries.size();
+        for (map<string,Entry>::const_iterator it=entries.begin(); !changed && it!=entries.end(); ++it) {
+            const Entry* e = lookup(it->first,it->second.size,it->second.mtime);
+            changed = e==NULL || e->basename!=it->second.basename || e->iconentry!=it->second.iconentry;
+        }
+        m_entries.swap(entries);
+        return changed;
+    }
+
+    bool load( const char* filename )
+    {
+        m_entries.clear();
+
+        FILE* fp = fopen(filename,"rb");
+        if (!fp) {
+            return false;
+        }
+
+        int version=0, count=0;
+        bool ok = fread(&version,sizeof(int),1,fp)==1 && version==INDEXFILEVERSION
+               && fread(&count,sizeof(int),1,fp)==1;
+
+        for (int i=0; ok && i<count; i++) {
+            string path;
+            Entry e;
+            ok = read_string(fp,path)
+              && fread(&e.size,sizeof(e.size),1,fp)==1
+              && fread(&e.mtime,sizeof(e.mtime),1,fp)==1
+              && read_string(fp,e.basename)
+              && read_string(fp,e.iconentry);
+            if (ok) {
+                m_entries[path] = e;
+            }
+        }
+        fclose(fp);
+
+        if (!ok) {
+            // truncated or from another version, start over
+            m_entries.clear();
+        }
+        return ok;
+    }
+
+    void save( const char* filename ) const
+    {
+        FILE* fp = fopen(filename,"wb");
+        if (fp) {
+            int version = INDEXFILEVERSION;
+            fwrite(&version,sizeof(int),1,fp);
+            int count = m_entries.size();
+            fwrite(&count,sizeof(int),1,fp);
+            for (map<string,Entry>::const_iterator it=m_entries.begin(); it!=m_entries.end(); ++it) {
+                write_string(fp,it->first);
+                fwrite(&it->second.size,sizeof(it->second.size),1,fp);
+                fwrite(&it->second.mtime,sizeof(it->second.mtime),1,fp);
+                write_string(fp,it->second.basename);
+                write_string(fp,it->second.iconentry);
+            }
+            fclose(fp);
+        }
+    }
+
+protected:
+    static void write_string( FILE* fp, const string& str )
+    {
+        int l = str.size();
+        fwrite(&l,sizeof(int),1,fp);
+        fwrite(str.c_str(),sizeof(char)*l,1,fp);
+    }
+
+    static bool read_string( FILE* fp, string& str )
+    {
+        int l=0;
+        if (fread(&l,sizeof(int),1,fp)!=1 || l<0 || l>PATH_MAX) {
+            return false;
+        }
+        str.resize(l);
+        return l==0 || fread(&str[0],sizeof(char)*l,1,fp)==1;
+    }
+
+private:
+    map<string,Entry> m_entries;
+};
+
+/// builds one ApkWidget into its slot, so the result keeps directory order
+class ScanApkJob : public Job
+{
+public:
+    ScanApkJob( const string& folder, const string& name, ApkWidget** slot ) :
+        m_folder(folder),
+        m_name(name),
+        m_slot(slot)
+    {
+    }
+
+    void run()
+    {
+        string path = m_folder+"/"+m_name;
+        ProfileScope profile("scan_apk",false,&path);
+        // truncated, half copied or gone again: no widget, the slot stays NULL
+        AndroidApk* apk = ApkWidget::S_HandlePool->acquire(path);
+        if (apk==NULL) {
+            cerr << "Failed to open " << path << endl;
+            return;
+        }
+        *m_slot = new ApkWidget(m_folder,m_name,apk);
+        ApkWidget::S_HandlePool->release(apk);
+    }
+
+private:
+    string m_folder;
+    string m_name;
+    ApkWidget** m_slot;
+};
+
+/// builds one widget per name into the matching slot of scanned, failed ones stay NULL.
+/// scan_threads<=0 uses one thread per cpu, apks found in the index are restored without opening them
+void scan_apks( const string& directory, const vector<string>& names, vector<ApkWidget*>* scanned, int scan_threads, const ApkIndex& index )
+{
+    scanned->assign(names.size(),(ApkWidget*)NULL);
+
+    // apk_open and apk_read_resources dominate, run them across the pool
+    WorkerPool pool(scan_threads);
+    for (int i=0,n=names.size(); i<n; i++) {
+        string path = directory+"/"+names[i];
+        struct stat st;
+        const ApkIndex::Entry* e = NULL;
+        if (stat(path.c_str(),&st)==0) {
+            e = index.lookup(path,st.st_size,st.st_mtime);
+        }
+        Profiler::add_count(e ? "index_hits" : "index_misses",1);
+        if (e) {
+            (*scanned)[i] = new ApkWidget(directory,names[i],e->basename,e->iconentry);
+        } else {
+            pool.add(new ScanApkJob(directory,names[i],&(*scanned)[i]));
+        }
+    }
+    pool.wait();
+}
+
+int list_apks( const char* dir0, vector<ApkWidget*>* apks, int scan_threads, const ApkIndex& index )
+{
+    string directory = my_realpath(dir0);
+
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        cerr << "Failed to open directory: " << directory << endl;
+        return 0;
+    }
+
+    vector<string> names;
     struct dirent* entry = 0;
     while ((entry=readdir(dir))!=0)
     {
         const char* ext = strrchr(entry->d_name,'.');
         if (ext!=NULL && strcmp(ext,".apk")==0)
         {
-            apks->push_back(new ApkWidget(directory,entry->d_name));
+            names.push_back(entry->d_name);
         }
     }
     closedir(dir);
 
+    vector<ApkWidget*> scanned;
+    scan_apks(directory,names,&scanned,scan_threads,index);
+
+    for (int i=0,n=scanned.size(); i<n; i++) {
+        if (scanned[i]) apks->push_back(scanned[i]);
+    }
+
     return apks->size();
 }
 
@@ -466,111 +1436,661 @@ void replace( string& inout, const string& find, const string& replace )
     }
 }
 
-void init_widgets(const vector<ApkWidget*>& apks, TTF_Font* font)
+/// prepares the label, surfaces are only created once the widget comes near the viewport
+void init_widget( ApkWidget* apk )
+{
+    string label = apk->get_apk_basename();
+    replace(label,".apk","");
+    replace(label,"_", " ");
+    apk->set_label(label);
+}
+
+void init_widgets(const vector<ApkWidget*>& apks)
 {
     for (int i=0,n=apks.size(); i<n; i++ ) {
-        apks[i]->extract_icon();
-        if (!apks[i]->load_icon(ICONMAXWIDTH,ICONMAXHEIGHT)) {
-            cerr << "Failed to load Icon for " << apks[i]->get_apk_filename() << endl;
+        init_widget(apks[i]);
+    }
+}
+
+/// takes a widget out of the grid, its icon may still be decoding so it is deleted later by free_retired
+void retire_apk( ApkWidget* apk, vector<ApkWidget*>* retired )
+{
+    ApkWidget::S_SurfaceCache->forget(apk);
+    apk->set_resident(false);
+    retired->push_back(apk);
+}
+
+/// deletes the retired widgets no icon job refers to anymore
+void free_retired( vector<ApkWidget*>& retired )
+{
+    int n = 0;
+    for (int i=0,m=retired.size(); i<m; i++) {
+        if (retired[i]->is_icon_pending()) {
+            retired[n++] = retired[i];
         } else {
-            //cerr << "Icon loaded for " << apks[i]->get_apk_filename() << endl;
+            // anything still in the cache would be evicted through a dangling pointer later
+            assert(!ApkWidget::S_SurfaceCache->is_tracked(retired[i]));
+            delete retired[i];
+        }
+    }
+    retired.resize(n);
+}
+
+/// the watcher lost events: compares the folder with the widgets and completes changes with what
+/// differs, new or modified apks as ADDED and vanished ones as REMOVED, so it still is one batch
+void rescan_changes( const char* dir0, const vector<ApkWidget*>& apks, FolderWatcher::Changes* changes )
+{
+    string directory = my_realpath(dir0);
+
+    map<string,const ApkWidget*> known;
+    for (int i=0,n=apks.size(); i<n; i++) {
+        known[apks[i]->get_apk_filename()] = apks[i];
+    }
+
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        cerr << "Failed to open directory: " << directory << endl;
+        return;
+    }
+    struct dirent* entry = 0;
+    while ((entry=readdir(dir))!=0)
+    {
+        const char* ext = strrchr(entry->d_name,'.');
+        if (ext==NULL || strcmp(ext,".apk")!=0) {
+            continue;
+        }
+        string path = directory+"/"+entry->d_name;
+        map<string,const ApkWidget*>::iterator it = known.find(path);
+        if (it==known.end()) {
+            (*changes)[entry->d_name] = FolderWatcher::ADDED;
+            continue;
         }
+        struct stat st;
+        if (stat(path.c_str(),&st)!=0 || st.st_size!=it->second->get_apk_size() || st.st_mtime!=it->second->get_apk_mtime()) {
+            (*changes)[entry->d_name] = FolderWatcher::ADDED;
+        } else if (changes->count(entry->d_name) && (*changes)[entry->d_name]==FolderWatcher::REMOVED) {
+            // removed and put back before the batch settled
+            changes->erase(entry->d_name);
+        }
+        known.erase(it);
+    }
+    closedir(dir);
 
-        string label = apks[i]->get_apk_basename();
-        replace(label,".apk","");
-        replace(label,"_", " ");
-        apks[i]->set_text(label,font);
+    for (map<string,const ApkWidget*>::const_iterator it=known.begin(); it!=known.end(); ++it) {
+        (*changes)[it->first.substr(directory.size()+1)] = FolderWatcher::REMOVED;
     }
 }
 
-void align_widgets(SDL_Surface *target, const vector<ApkWidget*>& apks)
+/// applies a batch of folder changes: only added or replaced apks are built, removed ones are
+/// retired and the rest keeps its order. new apks are appended. returns the first index whose
+/// widget changed, so the layout can be redone from there, or apks->size() if none did
+int update_apks( const char* dir0, const FolderWatcher::Changes& changes, vector<ApkWidget*>* apks,
+                 vector<ApkWidget*>* retired, int scan_threads, const ApkIndex& index )
 {
-    SDL_Rect rect = {0,TOPOFFSET,WIDGETWIDTH,WIDGETHEIGHT};
+    string directory = my_realpath(dir0);
 
-    int row = 0, col = 0;
-    for (int i=0,n=apks.size(); i<n; i++ ) {
+    map<string,int> slots;
+    for (int i=0,n=apks->size(); i<n; i++) {
+        slots[(*apks)[i]->get_apk_filename()] = i;
+    }
 
-        apks[i]->set_rect(rect);
-        apks[i]->set_row_column(row,col);
-        apks[i]->align_rect();
+    vector<bool> removed(apks->size(),false);
+    vector<string> names;
+    vector<int> targets;
+    for (FolderWatcher::Changes::const_iterator it=changes.begin(); it!=changes.end(); ++it) {
+        string path = directory+"/"+it->first;
+        ApkWidget::S_HandlePool->forget(path);
+        map<string,int>::const_iterator slot = slots.find(path);
+        int target = slot!=slots.end() ? slot->second : -1;
+        if (it->second==FolderWatcher::ADDED) {
+            names.push_back(it->first);
+            targets.push_back(target);
+        } else if (target>=0) {
+            removed[target] = true;
+        }
+    }
 
-        col ++;
-        rect.x += WIDGETWIDTH;
-        if (rect.x+WIDGETWIDTH>target->w)
-        {
-            col = 0; row ++;
-            rect.x = 0;
-            rect.y += WIDGETHEIGHT;
+    vector<ApkWidget*> scanned;
+    scan_apks(directory,names,&scanned,scan_threads,index);
+
+    int first = apks->size();
+    for (int i=0,n=names.size(); i<n; i++) {
+        int target = targets[i];
+        if (target<0) {
+            continue;
+        }
+        if (scanned[i]) {
+            // replaced in place, it keeps its grid slot
+            init_widget(scanned[i]);
+            retire_apk((*apks)[target],retired);
+            (*apks)[target] = scanned[i];
+            if (target<first) first = target;
+        } else {
+            removed[target] = true;
+        }
+    }
+
+    int count = 0;
+    for (int i=0,n=apks->size(); i<n; i++) {
+        if (removed[i]) {
+            retire_apk((*apks)[i],retired);
+            if (i<first) first = i;
+        } else {
+            (*apks)[count++] = (*apks)[i];
         }
     }
+    apks->resize(count);
+    if (count<first) first = count;
+
+    for (int i=0,n=names.size(); i<n; i++) {
+        if (targets[i]<0 && scanned[i]) {
+            init_widget(scanned[i]);
+            apks->push_back(scanned[i]);
+        }
+    }
+    return first;
 }
 
-void draw_widgets(SDL_Surface *target, SDL_Surface *selection, const vector<ApkWidget*>& apks)
+SDL_Surface* create_placeholder_icon()
 {
-    for (int i=0,n=apks.size(); i<n; i++ ) {
-        apks[i]->blit_to(selection,target);
+    SDL_Surface* placeholder = SDL_CreateRGBSurface(SDL_SWSURFACE, ICONMAXWIDTH, ICONMAXHEIGHT, 32,
+                                   0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
+    if (placeholder) {
+        rectangleRGBA(placeholder,0,0,placeholder->w-1,placeholder->h-1,PLACEHOLDERCOLOR);
+    }
+    return placeholder;
+}
+
+
+/** asynchronous icon loading **/
+
+/// extracts, decodes and scales icons on worker threads; the main loop picks them up via collect()
+class IconLoader
+{
+public:
+    IconLoader( int threads, IconAtlas* atlas ) :
+        m_atlas(atlas),
+        m_pending(0),
+        m_notified(false)
+    {
+        m_mutex = SDL_CreateMutex();
+        m_pool = new WorkerPool(threads);
+    }
+
+    virtual ~IconLoader()
+    {
+        // drops queued jobs and joins the running ones before the results go away.
+        // no widget is left pending, shown or not, so a new loader asks for its icon again
+        delete m_pool;
+        for (int i=0,n=m_done.size(); i<n; i++) {
+            m_done[i].first->set_icon_pending(false);
+            if (m_done[i].second) SDL_FreeSurface(m_done[i].second);
+        }
+        SDL_DestroyMutex(m_mutex);
+    }
+
+    /// lower priorities are decoded first
+    void request( ApkWidget* apk, int priority )
+    {
+        m_pending ++;
+        m_pool->add(new IconJob(this,apk),priority);
+    }
+
+    /// hands finished icons to their widgets, must be called from the main thread.
+    /// updated receives the widgets whose icon changed
+    int collect( vector<ApkWidget*>* updated )
+    {
+        vector< pair<ApkWidget*,SDL_Surface*> > done;
+        SDL_LockMutex(m_mutex);
+        done.swap(m_done);
+        m_notified = false;
+        SDL_UnlockMutex(m_mutex);
+
+        for (int i=0,n=done.size(); i<n; i++) {
+            SDL_Surface* page;
+            SDL_Rect rect;
+            done[i].first->set_icon_pending(false);
+            if (done[i].second==NULL) {
+                // stays on the placeholder until the folder watcher reports the file changed
+                done[i].first->set_icon_failed(true);
+            }
+            if (!done[i].first->is_resident()) {
+                // scrolled away meanwhile
+                if (done[i].second) SDL_FreeSurface(done[i].second);
+                continue;
+            }
+            if (done[i].second && m_atlas && m_atlas->add(done[i].second,&page,&rect)) {
+                SDL_FreeSurface(done[i].second);
+                done[i].first->set_icon_from_atlas(m_atlas,page,rect);
+            } else if (done[i].second) {
+                done[i].first->set_icon_surface(done[i].second);
+            } else {
+                cerr << "Failed to load Icon for " << done[i].first->get_apk_filename() << endl;
+                continue;
+            }
+            if (updated) updated->push_back(done[i].first);
+        }
+        m_pending -= done.size();
+        return done.size();
+    }
+
+    /// number of requested icons not yet collected
+    int get_pending() const
+    {
+        return m_pending;
+    }
+
+protected:
+    class IconJob : public Job
+    {
+    public:
+        IconJob( IconLoader* loader, ApkWidget* apk ) :
+            m_loader(loader),
+            m_apk(apk),
+            m_ran(false)
+        {
+        }
+
+        /// dropped by the pool before it ran, nothing will report back for the widget
+        virtual ~IconJob()
+        {
+            if (!m_ran) m_apk->set_icon_pending(false);
+        }
+
+        void run()
+        {
+            m_ran = true;
+            m_loader->finished(m_apk,m_apk->decode_apk_icon(ICONMAXWIDTH,ICONMAXHEIGHT));
+        }
+
+    private:
+        IconLoader* m_loader;
+        ApkWidget* m_apk;
+        bool m_ran;
+    };
+
+    void finished( ApkWidget* apk, SDL_Surface* icon )
+    {
+        SDL_LockMutex(m_mutex);
+        m_done.push_back(make_pair(apk,icon));
+        // one wake-up per batch, the main loop collects everything that arrived meanwhile.
+        // a full event queue refuses it, the next finished icon tries again
+        if (!m_notified) {
+            SDL_Event event;
+            memset(&event,0,sizeof(event));
+            event.type = SDL_USEREVENT;
+            event.user.code = EVENT_ICONSREADY;
+            m_notified = SDL_PushEvent(&event)==0;
+        }
+        SDL_UnlockMutex(m_mutex);
+    }
+
+private:
+    IconAtlas* m_atlas;
+    WorkerPool* m_pool;
+    SDL_mutex* m_mutex;
+    vector< pair<ApkWidget*,SDL_Surface*> > m_done;
+    int m_pending;
+    bool m_notified;
+};
+
+/** grid viewport **/
+
+/// the window of grid rows currently on screen
+class GridViewport
+{
+public:
+    GridViewport() :
+        m_first_row(0),
+        m_rows(1),
+        m_cols(1),
+        m_count(0),
+        m_scroll_offset(0)
+    {
+        memset(&m_rect,0,sizeof(m_rect));
+    }
+
+    void set_count( int count )
+    {
+        m_count = count;
+        scroll_to(m_first_row);
+    }
+
+    /// only full rows are shown, the space below stays free for the logo
+    void set_size( SDL_Surface* target, int count )
+    {
+        m_cols = target->w/WIDGETWIDTH;
+        if (m_cols<1) m_cols = 1;
+        m_rows = (target->h-TOPOFFSET)/WIDGETHEIGHT;
+        if (m_rows<1) m_rows = 1;
+        m_count = count;
+
+        SDL_Rect rect = {0,TOPOFFSET,Uint16(m_cols*WIDGETWIDTH),Uint16(m_rows*WIDGETHEIGHT)};
+        m_rect = rect;
+        scroll_to(m_first_row);
+    }
+
+    /// clamps and returns true if the first visible row changed
+    bool scroll_to( int first )
+    {
+        int maxfirst = get_total_rows()-m_rows;
+        if (first>maxfirst) first = maxfirst;
+        if (first<0) first = 0;
+        bool changed = first!=m_first_row;
+        m_first_row = first;
+        return changed;
+    }
+
+    bool scroll_by( int rows )
+    {
+        return scroll_to(m_first_row+rows);
+    }
+
+    /// scrolls just far enough to bring row on screen
+    bool ensure_visible( int row )
+    {
+        if (row<m_first_row) return scroll_to(row);
+        if (row>=m_first_row+m_rows) return scroll_to(row-m_rows+1);
+        return false;
+    }
+
+    bool is_visible_row( int row ) const
+    {
+        return row>=m_first_row && row<m_first_row+m_rows;
+    }
+
+    /// visible rows plus the prefetch margin
+    bool is_resident_row( int row ) const
+    {
+        return row>=m_first_row-PREFETCHROWS && row<m_first_row+m_rows+PREFETCHROWS;
+    }
+
+    /// range of widget indices on screen
+    int get_first_index() const
+    {
+        return m_first_row*m_cols;
+    }
+    int get_end_index() const
+    {
+        int end = (m_first_row+m_rows)*m_cols;
+        return end<m_count ? end : m_count;
+    }
+
+    /// screen rect of the cell at index, only meaningful for visible rows
+    SDL_Rect get_cell_rect( int index ) const
+    {
+        int row = index/m_cols, col = index%m_cols;
+        SDL_Rect rect = {
+            Sint16(m_rect.x+col*WIDGETWIDTH),
+            Sint16(m_rect.y+(row-m_first_row)*WIDGETHEIGHT),
+            WIDGETWIDTH,
+            WIDGETHEIGHT
+        };
+        return rect;
+    }
+
+    /// pixels the content is drawn below its cells while a scroll slides in, 0 at rest
+    void set_scroll_offset( int offset ) { m_scroll_offset = offset; }
+    int get_scroll_offset() const { return m_scroll_offset; }
+
+    int get_first_row() const { return m_first_row; }
+    int get_rows() const { return m_rows; }
+    int get_cols() const { return m_cols; }
+    int get_total_rows() const { return (m_count+m_cols-1)/m_cols; }
+
+    /// screen area covered by the grid
+    const SDL_Rect& get_rect() const
+    {
+        return m_rect;
+    }
+
+private:
+    SDL_Rect m_rect;
+    int m_first_row;
+    int m_rows;
+    int m_cols;
+    int m_count;
+    int m_scroll_offset;
+};
+
+/** grid index **/
+
+/// maps grid cells to widgets and keeps the selected index. widgets are laid out row by row,
+/// so a cell is just index=row*cols+col and selection, navigation and picking are O(1)
+class GridIndex
+{
+public:
+    GridIndex( const vector<ApkWidget*>* apks, GridViewport* viewport ) :
+        m_apks(apks),
+        m_viewport(viewport),
+        m_selected(-1),
+        m_resident_begin(0),
+        m_resident_end(0)
+    {
+    }
+
+    int get_count() const
+    {
+        return m_apks->size();
+    }
+
+    /// -1 if the cell is empty
+    int index_of( int row, int col ) const
+    {
+        int cols = m_viewport->get_cols();
+        if (row<0 || col<0 || col>=cols) return -1;
+        int i = row*cols+col;
+        return i<get_count() ? i : -1;
+    }
+
+    ApkWidget* at( int row, int col ) const
+    {
+        int i = index_of(row,col);
+        return i>=0 ? (*m_apks)[i] : NULL;
+    }
+
+    /// number of rows reaching down into col, the last row may be partial
+    int get_column_rows( int col ) const
+    {
+        int cols = m_viewport->get_cols();
+        int rows = m_viewport->get_total_rows();
+        int lastrow = get_count()-(rows-1)*cols;
+        return col<lastrow ? rows : rows-1;
+    }
+
+    /** selection **/
+
+    int get_selected() const
+    {
+        return m_selected;
+    }
+
+    ApkWidget* get_selected_apk() const
+    {
+        return m_selected>=0 ? (*m_apks)[m_selected] : NULL;
+    }
+
+    void select( int index )
+    {
+        if (index>=get_count()) index = get_count()-1;
+        if (m_selected>=0 && m_selected<get_count()) (*m_apks)[m_selected]->set_selected(0);
+        m_selected = index;
+        if (m_selected>=0) (*m_apks)[m_selected]->set_selected(1);
+    }
+
+    /// left/right walk the list and wrap around, up/down stay in the column and wrap around.
+    /// both may be more than one step, e.g. the net movement of several queued key presses
+    void move( int leftright, int updown )
+    {
+        int n = get_count();
+        if (n==0) return;
+        if (m_selected<0) {
+            select(0);
+            return;
+        }
+
+        int selected = m_selected;
+        if (leftright)
+        {
+            selected = ((selected+leftright)%n+n)%n;
+        }
+        if (updown)
+        {
+            int cols = m_viewport->get_cols();
+            int col = selected%cols;
+            int maxrow = get_column_rows(col);
+            int row = ((selected/cols+updown)%maxrow+maxrow)%maxrow;
+            selected = index_of(row,col);
+        }
+        select(selected);
+    }
+
+    /// the visible widget under mx,my or NULL
+    ApkWidget* pick( int mx, int my ) const
+    {
+        const SDL_Rect& grid = m_viewport->get_rect();
+        if (mx<grid.x || my<grid.y || mx>=grid.x+grid.w || my>=grid.y+grid.h) {
+            return NULL;
+        }
+        ApkWidget* apk = at(m_viewport->get_first_row()+(my-grid.y)/WIDGETHEIGHT,(mx-grid.x)/WIDGETWIDTH);
+        return apk && apk->pick(mx,my) ? apk : NULL;
+    }
+
+    /** layout **/
+
+    /// renumbers rows and columns from index from on, e.g. after widgets were inserted or removed there
+    void relayout( int from )
+    {
+        int cols = m_viewport->get_cols();
+        m_viewport->set_count(get_count());
+        if (m_selected>=get_count()) select(get_count()-1);
+        if (from<0) from = 0;
+        for (int i=from,n=get_count(); i<n; i++) {
+            (*m_apks)[i]->set_row_column(i/cols,i%cols);
+        }
+        // resident widgets behind from may have shifted out of the tracked range,
+        // let the next update_viewport look at all of them
+        if (from<m_resident_end) {
+            if (from<m_resident_begin) m_resident_begin = from;
+            m_resident_end = get_count();
+        }
+    }
+
+    /// places the resident widgets, creates surfaces for the ones entering the viewport (plus margin)
+    /// unless the surface cache still holds them, and hands the ones leaving it to the cache.
+    /// only the old and the new resident range are touched.
+    /// icons are queued by distance to the selected row, the selection itself first
+    void update_viewport( TTF_Font* font, SDL_Surface* placeholder, IconLoader* loader )
+    {
+        int cols = m_viewport->get_cols();
+        int begin = (m_viewport->get_first_row()-PREFETCHROWS)*cols;
+        int end = (m_viewport->get_first_row()+m_viewport->get_rows()+PREFETCHROWS)*cols;
+        if (begin<0) begin = 0;
+        if (end>get_count()) end = get_count();
+
+        for (int i=m_resident_begin,n=m_resident_end<get_count() ? m_resident_end : get_count(); i<n; i++) {
+            ApkWidget* apk = (*m_apks)[i];
+            if ((i<begin || i>=end) && apk->is_resident()) {
+                apk->set_resident(false);
+                ApkWidget::S_SurfaceCache->unpin(apk);
+            }
+        }
+        m_resident_begin = begin;
+        m_resident_end = end;
+
+        int selectedrow = m_selected>=0 ? m_selected/cols : m_viewport->get_first_row();
+        for (int i=begin; i<end; i++) {
+            ApkWidget* apk = (*m_apks)[i];
+            int row = i/cols, col = i%cols;
+
+            apk->set_rect(m_viewport->get_cell_rect(i));
+            apk->set_row_column(row,col);
+            apk->align_rect();
+
+            if (!apk->is_resident()) {
+                ApkWidget::S_SurfaceCache->count_lookup(apk->has_text() && apk->has_own_icon());
+                apk->set_resident(true);
+            }
+            if (!apk->has_text()) {
+                apk->set_text(apk->get_label(),font);
+            }
+            if (apk->is_icon_failed()) {
+                if (apk->get_icon_surface()==NULL) apk->set_icon_surface(placeholder,true);
+            } else if (!apk->has_own_icon() && !apk->is_icon_pending()) {
+                apk->set_icon_surface(placeholder,true);
+                int priority = i==m_selected ? 0 : 1 + abs(row-selectedrow) + (m_viewport->is_visible_row(row) ? 0 : m_viewport->get_rows());
+                apk->set_icon_pending(true);
+                loader->request(apk,priority);
+            }
+            ApkWidget::S_SurfaceCache->pin(apk);
+        }
+        ApkWidget::S_SurfaceCache->trim();
+    }
+
+    /// hands the resident widgets to the surface cache, e.g. before the list changes under the grid.
+    /// the ones resident again after the next update_viewport get their surfaces back from there
+    void detach()
+    {
+        for (int i=m_resident_begin,n=m_resident_end<get_count() ? m_resident_end : get_count(); i<n; i++) {
+            // retired widgets may still sit in the old range, they are out of the cache already
+            ApkWidget* apk = (*m_apks)[i];
+            if (apk->is_resident()) {
+                apk->set_resident(false);
+                ApkWidget::S_SurfaceCache->unpin(apk);
+            }
+        }
+        m_resident_begin = m_resident_end = 0;
     }
-}
 
-ApkWidget* pick_apk(int mx, int my, const vector<ApkWidget*>& apks )
-{
-    for (int i=0,n=apks.size(); i<n; i++)
+    /// drops every surface, e.g. while another app runs. the icon loader must be gone already,
+    /// deleting it clears the pending flags. the next update_viewport brings everything back
+    void release_surfaces()
     {
-        if (apks[i]->pick(mx,my))
-            return apks[i];
+        for (int i=m_resident_begin,n=m_resident_end<get_count() ? m_resident_end : get_count(); i<n; i++) {
+            ApkWidget::S_SurfaceCache->forget((*m_apks)[i]);
+            (*m_apks)[i]->set_resident(false);
+        }
+        m_resident_begin = m_resident_end = 0;
+        ApkWidget::S_SurfaceCache->clear();
     }
 
-    return NULL;
-}
+private:
+    const vector<ApkWidget*>* m_apks;
+    GridViewport* m_viewport;
+    int m_selected;
+    int m_resident_begin;
+    int m_resident_end;
+};
 
-int get_selected_apk(const vector<ApkWidget*>& apks)
+/// draws the visible widgets overlapping area
+void draw_widgets(SDL_Surface *target, SDL_Surface *selection, const vector<ApkWidget*>& apks, const GridViewport& viewport, const SDL_Rect& area)
 {
-     for (int i=0,n=apks.size(); i<n; i++) {
-        if(apks[i] && apks[i]->get_selected()) {
-            return i;
+    int offset = viewport.get_scroll_offset();
+    int first = viewport.get_first_index();
+    int end = viewport.get_end_index();
+    SDL_Rect clip = area;
+    SDL_Rect oldclip = target->clip_rect;
+
+    if (offset) {
+        // the rows sliding in or out come from the prefetch margin, nothing may leave the grid
+        first -= PREFETCHROWS*viewport.get_cols();
+        end += PREFETCHROWS*viewport.get_cols();
+        if (first<0) first = 0;
+        if (end>(int)apks.size()) end = apks.size();
+        if (!intersect_rect(area,viewport.get_rect(),&clip)) {
+            return;
         }
+        SDL_SetClipRect(target,&clip);
     }
-    return -1;
-}
-
-void select_apk(const vector<ApkWidget*>& apks, int leftright, int updown)
-{
-    int selected = get_selected_apk(apks);
-    if(selected<0) {
-        if(apks.size())
-            apks[0]->set_selected(1);
-    } else {
-
-        apks[selected]->set_selected(0);
 
-        if (leftright)
-        {
-            selected += leftright;
-            if (selected<0) selected = apks.size()-1;
-            if (selected>=apks.size()) selected = 0;
-        }
-        else
-        if (updown)
-        {
-            int maxrow = 0;
-            for (int i=0,n=apks.size();i<n;i++) {
-                if (apks[i]->get_col()==apks[selected]->get_col() && apks[i]->get_row()>maxrow) maxrow = apks[i]->get_row();
-            }
-            maxrow ++;
-            int row = apks[selected]->get_row() + updown;
-            int col = apks[selected]->get_col();
-            if (row<0) row = maxrow - 1;
-            if (row>=maxrow) row %= maxrow;
-
-            for (int i=0,n=apks.size();i<n;i++) {
-                if (apks[i]->get_row()==row && apks[i]->get_col()==col) {
-                    selected = i;
-                    break;
-                }
-            }
+    for (int i=first; i<end; i++ ) {
+        SDL_Rect rect = apks[i]->get_rect();
+        rect.y += offset;
+        if (intersect_rect(rect,clip,NULL)) {
+            apks[i]->blit_to(selection,target,offset);
         }
-        apks[selected]->set_selected(1);
-     }
+    }
+    SDL_SetClipRect(target,&oldclip);
 }
 
 
@@ -595,7 +2115,7 @@ public:
                 //lines.push_back(currentline);
                 //currentline.clear();
                 if (currentline.size()) {
-                    m_lines.push_back(TTF_RenderText_Blended(font,currentline.c_str(),color));
+                    m_lines.push_back(display_format(GlyphCache::get(font,color)->render(currentline.c_str()),true));
                 } else {
                     m_lines.push_back(NULL); //empty line
                 }
@@ -608,7 +2128,7 @@ public:
         }
 
         if (currentline.size()) {
-            m_lines.push_back(TTF_RenderText_Blended(font,currentline.c_str(),color));
+            m_lines.push_back(display_format(GlyphCache::get(font,color)->render(currentline.c_str()),true));
         }
     }
 
@@ -640,7 +2160,7 @@ protected:
                 textsurface->w,
                 textsurface->h
             };
-            SDL_BlitSurface(textsurface,NULL,target,&targetrect);
+            blit_surface(textsurface,NULL,target,&targetrect);
             return y + textsurface->h;
         }
         else
@@ -655,54 +2175,496 @@ private:
 };
 
 
-/** "config" file **/
+/** static layer **/
 
-void save_config( const string& apkname )
+/// background, logo, close button and the unselected widget grid, composited once in screen format.
+/// redraws copy from here and only add the selection frame on top
+class StaticLayer
 {
-    FILE* fp = fopen(CONFIGFILE,"wb");
-    if(fp) {
-        int version = CONFIGFILEVERSION;
-        fwrite(&version,sizeof(int),1,fp);
-        int l = apkname.size();
-        fwrite(&l,sizeof(int),1,fp);
-        fwrite(apkname.c_str(),sizeof(char)*l,1,fp);
-        fclose(fp);
+public:
+    StaticLayer( SDL_Surface* screen, SDL_Surface* background, SDL_Surface* logo, const SDL_Rect& logorect,
+                 Widget* closebutton, const vector<ApkWidget*>* apks, const GridViewport* viewport, TextSurface* errorscreen ) :
+        m_surface(NULL),
+        m_background(background),
+        m_logo(logo),
+        m_logorect(logorect),
+        m_closebutton(closebutton),
+        m_apks(apks),
+        m_viewport(viewport),
+        m_errorscreen(errorscreen),
+        m_filter(NULL)
+    {
+        memset(&m_patterned_grid,0,sizeof(m_patterned_grid));
+        resume(screen);
+    }
+
+    virtual ~StaticLayer()
+    {
+        release();
+    }
+
+    /// frees the layer, nothing may be drawn until resume()
+    void release()
+    {
+        if (m_surface) SDL_FreeSurface(m_surface);
+        m_surface = NULL;
+    }
+
+    /// recreates the layer for screen and recomposites it
+    void resume( SDL_Surface* screen )
+    {
+        release();
+        const SDL_PixelFormat* fmt = screen->format;
+        m_surface = SDL_CreateRGBSurface(SDL_SWSURFACE, screen->w, screen->h, fmt->BitsPerPixel,
+                                         fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask);
+        rebuild();
+    }
+
+    /// the filter text shown in the top bar, NULL while nothing is filtered. not owned
+    void set_filter( SDL_Surface* text )
+    {
+        m_filter = text;
+    }
+
+    /// recomposite everything, e.g. after the layout changed
+    void rebuild()
+    {
+        SDL_Rect all = {0,0,Uint16(m_surface->w),Uint16(m_surface->h)};
+        update(all);
+    }
+
+    /// recomposite one area, e.g. the rect of a widget whose icon changed
+    void update( const SDL_Rect& rect )
+    {
+        SDL_Rect area = rect;
+        SDL_SetClipRect(m_surface,&area);
+        area = m_surface->clip_rect;
+
+        SDL_BlitSurface(m_background,0,m_surface,0);
+
+        SDL_Rect logotarget = m_logorect;
+        blit_surface(m_logo,0,m_surface,&logotarget);
+
+        if (m_apks->size())
+            draw_widgets(m_surface,NULL,*m_apks,*m_viewport,area);
+        else if (m_filter==NULL)
+            m_errorscreen->blit_to(m_surface);
+
+        if (m_filter) {
+            SDL_Rect filterrect = {ICONOFFSET,Sint16((TOPOFFSET-m_filter->h)/2),Uint16(m_filter->w),Uint16(m_filter->h)};
+            blit_surface(m_filter,NULL,m_surface,&filterrect);
+        }
+
+        m_closebutton->blit_to(NULL,m_surface);
+
+        SDL_SetClipRect(m_surface,NULL);
+    }
+
+    /// the grid content moved dy pixels down (up if negative): the band that stays visible is
+    /// moved in place and only the rows sliding in are recomposited. where the background under
+    /// the grid is not the same from row to row, moving would drag it along, that is redrawn too
+    void scroll( int dy )
+    {
+        SDL_Rect grid = m_viewport->get_rect();
+        if (dy==0) {
+            return;
+        }
+        if (abs(dy)>=grid.h) {
+            update(grid);
+            return;
+        }
+
+        int bpp = m_surface->format->BytesPerPixel;
+        int pitch = m_surface->pitch;
+        int rows = grid.h-abs(dy);
+        Uint8* base = (Uint8*)m_surface->pixels+grid.x*bpp;
+        if (dy>0) {
+            for (int y=rows-1; y>=0; y--) {
+                memcpy(base+(grid.y+y+dy)*pitch,base+(grid.y+y)*pitch,grid.w*bpp);
+            }
+        } else {
+            for (int y=0; y<rows; y++) {
+                memcpy(base+(grid.y+y)*pitch,base+(grid.y+y-dy)*pitch,grid.w*bpp);
+            }
+        }
+
+        SDL_Rect exposed = grid;
+        exposed.h = abs(dy);
+        if (dy<0) exposed.y = grid.y+grid.h+dy;
+        update(exposed);
+
+        // pixels that left a patterned spot or landed on one
+        const vector<SDL_Rect>& patterned = get_patterned(grid);
+        for (int i=0,n=patterned.size(); i<n; i++) {
+            SDL_Rect moved = patterned[i];
+            moved.y += dy;
+            SDL_Rect area;
+            if (intersect_rect(patterned[i],grid,&area)) update(area);
+            if (intersect_rect(moved,grid,&area)) update(area);
+        }
+    }
+
+    /// copies area to the same spot on target
+    void blit_to( SDL_Surface* target, const SDL_Rect& area )
+    {
+        SDL_Rect src = area;
+        SDL_Rect dst = area;
+        SDL_BlitSurface(m_surface,&src,target,&dst);
+    }
+
+protected:
+    /// the spots of grid where the layer is not the same in every row without widgets:
+    /// background rows that differ from its most common one, plus logo and close button.
+    /// only depends on the background, so it is worked out once per grid rect
+    const vector<SDL_Rect>& get_patterned( const SDL_Rect& grid )
+    {
+        if (grid.x==m_patterned_grid.x && grid.y==m_patterned_grid.y
+            && grid.w==m_patterned_grid.w && grid.h==m_patterned_grid.h) {
+            return m_patterned;
+        }
+        m_patterned_grid = grid;
+        m_patterned.clear();
+
+        const SDL_PixelFormat* fmt = m_background->format;
+        if (fmt->BytesPerPixel!=m_surface->format->BytesPerPixel
+            || grid.x+grid.w>m_background->w || grid.y+grid.h>m_background->h
+            || (SDL_MUSTLOCK(m_background) && SDL_LockSurface(m_background)<0)) {
+            // nothing to go by, every scroll step recomposites the whole grid
+            m_patterned.push_back(grid);
+            return m_patterned;
+        }
+        int bpp = fmt->BytesPerPixel;
+        const Uint8* base = (const Uint8*)m_background->pixels+grid.x*bpp;
+        int pitch = m_background->pitch;
+
+        // the most common row is the one flat areas are made of
+        map<Uint32,int> counts;
+        vector<Uint32> hashes(grid.h);
+        int reference = 0;
+        for (int y=0; y<grid.h; y++) {
+            const Uint8* row = base+(grid.y+y)*pitch;
+            Uint32 hash = 2166136261u;
+            for (int x=0; x<grid.w*bpp; x++) {
+                hash = (hash^row[x])*16777619u;
+            }
+            hashes[y] = hash;
+            if (++counts[hash]>counts[hashes[reference]]) reference = y;
+        }
+        const Uint8* flat = base+(grid.y+reference)*pitch;
+
+        // consecutive rows that differ become one rect around their differing pixels
+        bool open = false;
+        SDL_Rect run = {0,0,0,0};
+        for (int y=0; y<=grid.h; y++) {
+            int first = grid.w, last = -1;
+            if (y<grid.h) {
+                const Uint8* row = base+(grid.y+y)*pitch;
+                if (hashes[y]!=hashes[reference] || memcmp(row,flat,grid.w*bpp)!=0) {
+                    for (int x=0; x<grid.w; x++) {
+                        if (memcmp(row+x*bpp,flat+x*bpp,bpp)!=0) {
+                            if (first>x) first = x;
+                            last = x;
+                        }
+                    }
+                }
+            }
+            if (last>=0) {
+                SDL_Rect rect = {Sint16(grid.x+first),Sint16(grid.y+y),Uint16(last-first+1),1};
+                run = open ? union_rect(run,rect) : rect;
+                open = true;
+            } else if (open) {
+                m_patterned.push_back(run);
+                open = false;
+            }
+        }
+        if (SDL_MUSTLOCK(m_background)) SDL_UnlockSurface(m_background);
+
+        SDL_Rect area;
+        if (intersect_rect(m_logorect,grid,&area)) m_patterned.push_back(area);
+        if (intersect_rect(m_closebutton->get_rect(),grid,&area)) m_patterned.push_back(area);
+        return m_patterned;
+    }
+
+private:
+    SDL_Surface* m_surface;
+    SDL_Surface* m_background;
+    SDL_Surface* m_logo;
+    SDL_Rect m_logorect;
+    Widget* m_closebutton;
+    const vector<ApkWidget*>* m_apks;
+    const GridViewport* m_viewport;
+    TextSurface* m_errorscreen;
+    SDL_Surface* m_filter;
+    vector<SDL_Rect> m_patterned;
+    SDL_Rect m_patterned_grid;
+};
+
+
+/** filter **/
+
+/// label ids are the positions in apks, so this has to follow every change of the list
+void index_labels( const vector<ApkWidget*>& apks, LabelIndex* labels )
+{
+    vector<string> names(apks.size());
+    for (int i=0,n=apks.size(); i<n; i++) {
+        names[i] = apks[i]->get_label();
     }
+    labels->build(names);
 }
 
-string load_config()
+/// shows the apks matching the filter. widgets on screen before and after keep their label
+/// and icon, the ones that went away are left to the surface cache. stays on keep if it is still shown
+void show_matches( const vector<ApkWidget*>& apks, const LabelIndex& labels, vector<ApkWidget*>* shown, ApkWidget* keep,
+                   GridIndex* grid, GridViewport* viewport, TTF_Font* font, SDL_Surface* placeholder, IconLoader* loader )
 {
-    FILE* fp = fopen(CONFIGFILE,"rb");
-    if(fp){
-        int version=0;
-        if (fread(&version,sizeof(int),1,fp)!=1 || version!=CONFIGFILEVERSION) {
-            fclose(fp);
-            return "";
+    ProfileScope profile("filter");
+
+    grid->select(-1);
+    grid->detach();
+
+    const vector<int>& matches = labels.get_matches();
+    int selected = matches.empty() ? -1 : 0;
+    shown->resize(matches.size());
+    for (int i=0,n=matches.size(); i<n; i++) {
+        (*shown)[i] = apks[matches[i]];
+        if ((*shown)[i]==keep) selected = i;
+    }
+
+    grid->relayout(0);
+    grid->select(selected);
+    if (selected>=0) {
+        viewport->ensure_visible((*shown)[selected]->get_row());
+    }
+    grid->update_viewport(font,placeholder,loader);
+}
+
+/// the query as shown in the top bar, NULL without one
+SDL_Surface* render_filter( const LabelIndex& labels, TTF_Font* font, const SDL_Color& color )
+{
+    if (!labels.is_filtering()) {
+        return NULL;
+    }
+    string text = "Filter: " + labels.get_query();
+    return display_format(GlyphCache::get(font,color)->render(text.c_str()),true);
+}
+
+
+/** animations **/
+
+/// slides the grid content from where it was to the new first row
+class ScrollAnimation : public Animation
+{
+public:
+    ScrollAnimation( GridViewport* viewport, StaticLayer* layer, DirtyRects* dirty ) :
+        m_viewport(viewport),
+        m_layer(layer),
+        m_dirty(dirty),
+        m_from(0),
+        m_elapsed(0)
+    {
+    }
+
+    /// rows: how far the first row just moved. returns false if that is too far to slide,
+    /// only the prefetched rows are there to fill the gap, the grid jumps then
+    bool scroll( int rows )
+    {
+        int offset = m_viewport->get_scroll_offset()+rows*WIDGETHEIGHT;
+        if (rows==0 || abs(offset)>PREFETCHROWS*WIDGETHEIGHT) {
+            m_viewport->set_scroll_offset(0);
+            return false;
         }
-        int l=0;
-        if (fread(&l,sizeof(int),1,fp)!=1) {
-            fclose(fp);
-            return "";
+        m_from = offset;
+        m_elapsed = 0;
+        m_viewport->set_scroll_offset(offset);
+        return true;
+    }
+
+    bool step( int dt )
+    {
+        m_elapsed += dt;
+        int offset = int(m_from*(1-ease_out(float(m_elapsed)/SCROLLDURATION)));
+        int moved = offset-m_viewport->get_scroll_offset();
+        m_viewport->set_scroll_offset(offset);
+        m_layer->scroll(moved);
+        m_dirty->add_band(m_viewport->get_rect());
+        return offset!=0;
+    }
+
+private:
+    GridViewport* m_viewport;
+    StaticLayer* m_layer;
+    DirtyRects* m_dirty;
+    int m_from;
+    int m_elapsed;
+};
+
+/// slides the selection frame to the selected widget, which may be sliding with the grid itself
+class SelectionAnimation : public Animation
+{
+public:
+    SelectionAnimation( const GridIndex* grid, const GridViewport* viewport, DirtyRects* dirty ) :
+        m_grid(grid),
+        m_viewport(viewport),
+        m_dirty(dirty),
+        m_drawn_valid(false),
+        m_elapsed(SELECTIONDURATION)
+    {
+        memset(&m_from,0,sizeof(m_from));
+        memset(&m_drawn,0,sizeof(m_drawn));
+    }
+
+    /// call after the selection changed, returns true if the frame has a way to go
+    bool retarget()
+    {
+        SDL_Rect target;
+        bool visible = get_target(&target);
+        if (m_drawn_valid && visible) {
+            m_from = m_drawn;
+            m_elapsed = 0;
+            return true;
         }
-        string apkname;
-        char *tmp = new char[l+1];
-        if (fread(tmp,sizeof(char)*l,1,fp)==1)
-        {
-            tmp[l] = 0;
-            apkname = tmp;
+        // nothing to slide from or to, just swap
+        if (m_drawn_valid) m_dirty->add(m_drawn);
+        if (visible) m_dirty->add(target);
+        m_elapsed = SELECTIONDURATION;
+        return false;
+    }
+
+    bool step( int dt )
+    {
+        m_elapsed += dt;
+        SDL_Rect rect;
+        if (m_drawn_valid) m_dirty->add(m_drawn);
+        if (get_rect(&rect)) m_dirty->add(rect);
+        return m_elapsed<SELECTIONDURATION;
+    }
+
+    /// where the frame is drawn now, false if the selection is off screen
+    bool get_rect( SDL_Rect* rect )
+    {
+        SDL_Rect target;
+        m_drawn_valid = get_target(&target);
+        if (!m_drawn_valid) {
+            return false;
         }
-        fclose(fp);
-        delete [] tmp;
-        //cout << "config apk = " << apkname << endl;
-        return apkname;
+        if (m_elapsed<SELECTIONDURATION) {
+            float t = ease_out(float(m_elapsed)/SELECTIONDURATION);
+            target.x = Sint16(m_from.x+(target.x-m_from.x)*t);
+            target.y = Sint16(m_from.y+(target.y-m_from.y)*t);
+        }
+        m_drawn = target;
+        *rect = target;
+        return true;
     }
-    return "";
-}
+
+protected:
+    bool get_target( SDL_Rect* rect ) const
+    {
+        const ApkWidget* apk = m_grid->get_selected_apk();
+        if (apk==NULL || !m_viewport->is_visible_row(apk->get_row())) {
+            return false;
+        }
+        *rect = apk->get_rect();
+        rect->y += m_viewport->get_scroll_offset();
+        return true;
+    }
+
+private:
+    const GridIndex* m_grid;
+    const GridViewport* m_viewport;
+    DirtyRects* m_dirty;
+    SDL_Rect m_from;
+    SDL_Rect m_drawn;
+    bool m_drawn_valid;
+    int m_elapsed;
+};
+
 
 /** main */
 
+/// time from the first input event after a flip until the flip that shows its result.
+/// sdl 1.2 events carry no timestamp, so time spent in the queue before the event was taken is not included
+class LatencyStats
+{
+public:
+    LatencyStats() :
+        m_count(0),
+        m_total(0),
+        m_max(0)
+    {
+    }
+
+    void add( Uint64 latency )
+    {
+        m_count ++;
+        m_total += latency;
+        if (latency>m_max) m_max = latency;
+        Profiler::add_time("input_latency",latency,NULL);
+    }
+
+    void print_stats( ostream& out ) const
+    {
+        out << "input latency: " << m_count << " frames";
+        if (m_count>0) {
+            out << ", " << (m_total/m_count/1000.0f) << "ms average, " << (m_max/1000.0f) << "ms max";
+        }
+        out << endl;
+    }
+
+private:
+    int m_count;
+    Uint64 m_total;
+    Uint64 m_max;
+};
+
+/// brings the video mode back after the resident mode handed it to apkenv
+SDL_Surface* open_video( SDL_Surface* wmicon )
+{
+    if (SDL_InitSubSystem(SDL_INIT_VIDEO)<0) {
+        cerr << "Unable to init SDL: " << SDL_GetError() << endl;
+        return NULL;
+    }
+    SDL_Surface* screen = SDL_SetVideoMode(SCREENWIDTH, SCREENHEIGHT, SCREENBITS, SDL_VIDEOMODE);
+    if (!screen) {
+        cerr << "Unable to set " << SCREENWIDTH << "x" << SCREENHEIGHT << " video mode. Error: " << SDL_GetError() << endl;
+        return NULL;
+    }
+    SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY, SDL_DEFAULT_REPEAT_INTERVAL);
+    SDL_EnableUNICODE(1);
+#ifdef PANDORA
+    SDL_ShowCursor(0);
+#endif
+    SDL_WM_SetIcon(wmicon,NULL);
+    SDL_WM_SetCaption("apkenv.ui","apkenv.ui");
+    return screen;
+}
+
 int main ( int argc, char** argv )
 {
+    int scanthreads = 0;
+    bool printstats = false;
+    int benchkeys = 0;
+    bool resident = false;
+    size_t surfacebudget = SURFACEBUDGET;
+    for (int i=1; i<argc; i++) {
+        if (strncmp(argv[i],"--scan-threads=",15)==0) {
+            scanthreads = atoi(argv[i]+15);
+        } else if (strcmp(argv[i],"--stats")==0) {
+            printstats = true;
+        } else if (strncmp(argv[i],"--profile=",10)==0) {
+            Profiler::enable(argv[i]+10);
+        } else if (strncmp(argv[i],"--bench-keys=",13)==0) {
+            benchkeys = atoi(argv[i]+13);
+        } else if (strcmp(argv[i],"--resident")==0) {
+            resident = true;
+        } else if (strncmp(argv[i],"--surface-budget=",17)==0) {
+            surfacebudget = size_t(atoi(argv[i]+17))*1024;
+        } else {
+            cerr << "Unknown option: " << argv[i] << endl;
+        }
+    }
+
+    Uint64 phasestart = Profiler::now();
     if (TTF_Init()<0)
     {
         cerr << "Unable to init TTF: " << TTF_GetError()  << endl;
@@ -714,12 +2676,14 @@ int main ( int argc, char** argv )
         cerr << "Unable to init SDL: " << SDL_GetError()  << endl;
         return 1;
     }
+    Profiler::add_phase("sdl_init",phasestart,Profiler::now());
 
     if ((SDL_VIDEOMODE&SDL_FULLSCREEN)==0) {
         SDL_putenv("SDL_VIDEO_CENTERED=center"); //Center the game Window
     }
 
     SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY, SDL_DEFAULT_REPEAT_INTERVAL);
+    SDL_EnableUNICODE(1);
 #ifdef PANDORA
     SDL_ShowCursor(0);
 #endif
@@ -728,7 +2692,9 @@ int main ( int argc, char** argv )
     mkdir( my_realpath(APKFOLDER).c_str(), 0700 );
 
     // create a new window
+    phasestart = Profiler::now();
     SDL_Surface* screen = SDL_SetVideoMode(SCREENWIDTH, SCREENHEIGHT, SCREENBITS, SDL_VIDEOMODE);
+    Profiler::add_phase("set_video_mode",phasestart,Profiler::now());
     if ( !screen )
     {
         cerr << "Unable to set " << SCREENWIDTH << "x" << SCREENHEIGHT << " video mode. Error: " << SDL_GetError() << endl;
@@ -737,7 +2703,8 @@ int main ( int argc, char** argv )
 
 
 // load background image
-    SDL_Surface* background = IMG_Load(BACKGROUNDIMAGE);
+    phasestart = Profiler::now();
+    SDL_Surface* background = display_format(IMG_Load(BACKGROUNDIMAGE),false);
 
 // selection
     Uint32 rmask, gmask, bmask, amask;
@@ -749,11 +2716,16 @@ int main ( int argc, char** argv )
                                    rmask, gmask, bmask, amask);
 
     rectangleRGBA(selection,1,1,selection->w-1,selection->h-1,SELECTIONCOLOR);
+    selection = display_format(selection,true);
+
+    Profiler::add_phase("load_images",phasestart,Profiler::now());
 
 // fooonts
+    phasestart = Profiler::now();
     TTF_Font* fontbig = TTF_OpenFont(FONTFACE,FONTHEIGHTBIG);
     TTF_Font* fontsmall = TTF_OpenFont(FONTFACE,FONTHEIGHTSMALL);
     SDL_Color fontcolor = {FONTCOLOR};
+    Profiler::add_phase("open_fonts",phasestart,Profiler::now());
 
 // prepare info text rendering
     char errotext[1024];
@@ -772,36 +2744,71 @@ int main ( int argc, char** argv )
 // close button
     Widget* closebutton = new Widget();
     closebutton->load_icon_surface(CLOSEIMAGE,0,0);
+    closebutton->convert_to_display_format();
     SDL_Surface* closesurface = closebutton->get_icon_surface();
     SDL_Rect closerect = {screen->w-closesurface->w,0,closesurface->w,closesurface->h};
     closebutton->set_rect(closerect);
 
 // dragonbox logo
-    SDL_Surface* logo = IMG_Load(LOGOIMAGE);
+    SDL_Surface* logo = display_format(IMG_Load(LOGOIMAGE),true);
     SDL_Rect logorect = {screen->w-logo->w-ICONOFFSET,screen->h-logo->h-ICONOFFSET,logo->w,logo->h};
 
 // search for apks
     vector<ApkWidget*> apks;
-
-    if (list_apks(APKFOLDER,&apks)>0)
+    vector<ApkWidget*> shown;   // what the grid shows, apks or the ones matching the filter
+    LabelIndex labelindex;
+    SDL_Surface* filtertext = NULL;
+    ApkIndex apkindex;
+    apkindex.load(INDEXFILE);
+    ApkWidget::S_CacheWriter = new DeferredWriter(CACHEWRITEDELAY);
+    ApkWidget::S_HandlePool = new ApkHandlePool(APKHANDLEPOOLSIZE);
+    ApkWidget::S_SurfaceCache = new SurfaceCache(surfacebudget);
+    SDL_Surface* placeholder = create_placeholder_icon();
+    IconAtlas* iconatlas = new IconAtlas(ICONMAXWIDTH,ICONMAXHEIGHT,ATLASPAGESIZE);
+    IconLoader* iconloader = new IconLoader(scanthreads,iconatlas);
+    bool indexsaved = false;
+    LaunchHistory history;
+    history.load(CONFIGFILE);
+    Readahead* readahead = new Readahead(READAHEADMAXBYTES);
+    bool prefetched = false;
+    GridViewport viewport;
+    GridIndex grid(&shown,&viewport);
+    vector<ApkWidget*> retired;
+
+    // watch before scanning, so nothing copied meanwhile is missed
+    FolderWatcher* folderwatcher = new FolderWatcher(my_realpath(APKFOLDER),".apk",FOLDERSETTLEDELAY,EVENT_FOLDERCHANGED);
+
+    phasestart = Profiler::now();
+    list_apks(APKFOLDER,&apks,scanthreads,apkindex);
+    Profiler::add_phase("list_apks",phasestart,Profiler::now());
+    Profiler::set_count("apks",apks.size());
+
+    phasestart = Profiler::now();
+    shown = apks;
+    viewport.set_size(screen,shown.size());
+    if (shown.size()>0)
     {
-        // initialize their icons
-        init_widgets(apks,fontsmall);
-        // align icons
-        align_widgets(screen,apks);
+        // labels only, surfaces follow once a widget is near the viewport
+        init_widgets(apks);
+        index_labels(apks,&labelindex);
+        grid.relayout(0);
         // select the first one
-        apks[0]->set_selected(1);
+        grid.select(0);
 
         // select the old one
-        string prevapk = load_config();
-        for (int i=0,n=apks.size(); i<n;i++) {
-            if (apks[i]->get_apk_filename()==prevapk) {
-                apks[0]->set_selected(0);
-                apks[i]->set_selected(1);
+        string prevapk = history.get_last();
+        for (int i=0,n=shown.size(); i<n;i++) {
+            if (shown[i]->get_apk_filename()==prevapk) {
+                grid.select(i);
                 break;
             }
         }
+
+        // align icons around the selection, the icons follow asynchronously
+        viewport.ensure_visible(shown[grid.get_selected()]->get_row());
+        grid.update_viewport(fontsmall,placeholder,iconloader);
     }
+    Profiler::add_phase("layout",phasestart,Profiler::now());
 
 
 
@@ -811,80 +2818,438 @@ int main ( int argc, char** argv )
     ApkWidget* tmpapk = NULL;
 
 
+    // partial updates only work without page flipping
+    bool partialupdates = (screen->flags&(SDL_HWSURFACE|SDL_DOUBLEBUF))!=(SDL_HWSURFACE|SDL_DOUBLEBUF);
+    DirtyRects dirty(screen->w,screen->h);
+    dirty.invalidate_all();
+    phasestart = Profiler::now();
+    StaticLayer staticlayer(screen,background,logo,logorect,closebutton,&shown,&viewport,&errorscreen);
+    Profiler::add_phase("static_layer",phasestart,Profiler::now());
+    AnimationScheduler animations(FRAMEINTERVAL);
+    ScrollAnimation scrollanim(&viewport,&staticlayer,&dirty);
+    SelectionAnimation selectionanim(&grid,&viewport,&dirty);
+    bool firstframe = true;
+    bool iconsready = false;
+    Uint64 benchkeystart = 0;
+    bool benchkeyhandled = false;
+    Uint32 lastflip = 0;
+    Uint64 inputtime = 0;   // first input since the last flip
+    LatencyStats latency;
+
     bool done = false;
-    while (!done && runapk.size()==0)
+    while (!done && (resident || runapk.size()==0))
     {
-        SDL_BlitSurface(background,0,screen,0);
+        if (!partialupdates && !dirty.empty()) {
+            dirty.invalidate_all();
+        }
 
-        SDL_BlitSurface(logo,0,screen,&logorect);
+        if (!dirty.empty())
+        {
+            // at most one frame per refresh, whatever arrives meanwhile is drained into the next one
+            Uint32 sinceflip = SDL_GetTicks()-lastflip;
+            if (sinceflip<FRAMEINTERVAL) {
+                // the wait is pacing, not work: move the pending timings past it
+                Uint64 waitstart = Profiler::now();
+                SDL_Delay(FRAMEINTERVAL-sinceflip);
+                Uint64 waited = Profiler::now()-waitstart;
+                if (inputtime) inputtime += waited;
+                if (benchkeystart) benchkeystart += waited;
+            }
 
-        if (apks.size())
-            draw_widgets(screen,selection,apks);
-        else
-            errorscreen.blit_to(screen);
+            vector<SDL_Rect> rects = dirty.get_rects();
+            for (int r=0,nr=rects.size(); r<nr; r++)
+            {
+                SDL_Rect area = rects[r];
+                staticlayer.blit_to(screen,area);
+
+                // the frame hugs the widget border, icon and label never reach it, so drawing it last is safe
+                SDL_Rect frame, clip;
+                if (selectionanim.get_rect(&frame) && intersect_rect(frame,area,NULL)
+                    && intersect_rect(area,viewport.get_rect(),&clip)) {
+                    SDL_SetClipRect(screen,&clip);
+                    blit_surface(selection,NULL,screen,&frame);
+                }
+            }
+            SDL_SetClipRect(screen,NULL);
+
+            if (dirty.is_full())
+                SDL_Flip(screen);
+            else
+                SDL_UpdateRects(screen,rects.size(),&rects[0]);
+            dirty.clear();
+            lastflip = SDL_GetTicks();
+
+            if (inputtime) {
+                latency.add(Profiler::now()-inputtime);
+                inputtime = 0;
+            }
 
-        closebutton->blit_to(NULL,screen);
+            if (firstframe) {
+                // from process start, the placeholders are up at this point
+                Profiler::add_phase("first_frame",0,Profiler::now());
+                firstframe = false;
+            }
+        }
+
+        // --bench-keys: one synthetic key at a time once the icons are in, timed until its redraw is out
+        if (benchkeystart && benchkeyhandled) {
+            Profiler::add_time("keypress_redraw",Profiler::now()-benchkeystart,NULL);
+            benchkeystart = 0;
+            benchkeyhandled = false;
+            if (--benchkeys==0) {
+                SDL_Event quit;
+                memset(&quit,0,sizeof(quit));
+                quit.type = SDL_QUIT;
+                SDL_PushEvent(&quit);
+            }
+        }
+        if (benchkeys>0 && !benchkeystart && iconsready && iconloader->get_pending()==0 && !animations.is_active()) {
+            SDL_Event key;
+            memset(&key,0,sizeof(key));
+            key.type = SDL_KEYDOWN;
+            key.key.state = SDL_PRESSED;
+            key.key.keysym.sym = benchkeys%4==0 ? SDLK_DOWN : SDLK_RIGHT;
+            benchkeystart = Profiler::now();
+            SDL_PushEvent(&key);
+        }
 
-        SDL_Flip(screen);
+        // idle from here on: warm the page cache with the apks most likely launched next
+        if (!prefetched && dirty.empty() && !animations.is_active() && iconloader->get_pending()==0) {
+            vector<string> likely;
+            history.rank(&likely,READAHEADAPKS);
+            readahead->prefetch(likely);
+            prefetched = true;
+        }
 
-// using waitevent not poll ... no per-frame updated needed
+// using waitevent not poll ... no per-frame updated needed, unless something is moving
         SDL_Event event;
-        if (SDL_WaitEvent(&event))
+        if (animations.is_active() ? SDL_PollEvent(&event) : SDL_WaitEvent(&event))
         {
-            switch (event.type)
+            int prevselected = grid.get_selected();
+            int prevfirstrow = viewport.get_first_row();
+            bool scrolled = false;
+            int moveleftright = 0, moveupdown = 0, scrollrows = 0;
+            bool filterchanged = false;
+
+            // drain everything queued before drawing again, a held key repeats faster than frames are drawn
+            do
             {
-            case SDL_QUIT:
-                done = true;
-                break;
+                if (inputtime==0 && (event.type==SDL_KEYDOWN || event.type==SDL_MOUSEBUTTONDOWN)) {
+                    inputtime = Profiler::now();
+                }
 
-            case SDL_KEYDOWN:
-                switch(event.key.keysym.sym)
+                switch (event.type)
                 {
-                default: break;
-                case SDLK_ESCAPE: done = true; break;
-                case SDLK_LEFT: select_apk(apks,-1,0); break;
-                case SDLK_RIGHT: select_apk(apks,1,0); break;
-                case SDLK_UP: select_apk(apks,0,-1); break;
-                case SDLK_DOWN: select_apk(apks,0,+1); break;
-#ifdef PANDORA
-                case SDLK_HOME:
-                case SDLK_END:
-                case SDLK_PAGEUP:
-                case SDLK_PAGEDOWN:
-#endif
-                case SDLK_RETURN:
+                case SDL_QUIT:
+                    done = true;
+                    break;
+
+                case SDL_ACTIVEEVENT:
+                case SDL_VIDEOEXPOSE:
+                    dirty.invalidate_all();
+                    break;
+
+                case SDL_USEREVENT:
+                    if (event.user.code==EVENT_ICONSREADY) {
+                        vector<ApkWidget*> updated;
+                        iconloader->collect(&updated);
+                        for (int i=0,n=updated.size(); i<n; i++) {
+                            ApkWidget::S_SurfaceCache->pin(updated[i]);
+                            // prefetched rows are off screen, their surfaces are just kept ready.
+                            // while the grid slides the widget is drawn that far off its cell
+                            SDL_Rect rect = updated[i]->get_rect();
+                            rect.y += viewport.get_scroll_offset();
+                            if (intersect_rect(rect,viewport.get_rect(),&rect)) {
+                                staticlayer.update(rect);
+                                dirty.add(rect);
+                            }
+                        }
+                        ApkWidget::S_SurfaceCache->trim();
+                        free_retired(retired);
+                    }
+                    else
+                    if (event.user.code==EVENT_FOLDERCHANGED) {
+                        FolderWatcher::Changes changes;
+                        bool overflowed = false;
+                        folderwatcher->collect(&changes,&overflowed);
+                        if (overflowed) {
+                            rescan_changes(APKFOLDER,apks,&changes);
+                        }
+
+                        ApkWidget* selectedapk = grid.get_selected_apk();
+                        int oldcount = apks.size();
+                        int oldfirstrow = viewport.get_first_row();
+                        grid.select(-1);
+
+                        // the whole burst goes through one layout pass
+                        int from = update_apks(APKFOLDER,changes,&apks,&retired,scanthreads,apkindex);
+                        if (from<oldcount || from<(int)apks.size()) {
+                            index_labels(apks,&labelindex);
+                            if (labelindex.is_filtering()) {
+                                // the matches may have moved anywhere, lay them out again
+                                show_matches(apks,labelindex,&shown,selectedapk,&grid,&viewport,fontsmall,placeholder,iconloader);
+                                staticlayer.rebuild();
+                                dirty.invalidate_all();
+                            } else {
+                                shown = apks;
+
+                                // stay on the same apk, or on the same slot if it went away
+                                int selected = prevselected;
+                                for (int i=0,n=shown.size(); i<n; i++) {
+                                    if (shown[i]==selectedapk) {
+                                        selected = i;
+                                        break;
+                                    }
+                                }
+                                if (selected<0) selected = 0;
+                                grid.relayout(from);
+                                grid.select(selected);
+                                if (grid.get_selected()>=0) {
+                                    viewport.ensure_visible(shown[grid.get_selected()]->get_row());
+                                }
+                                grid.update_viewport(fontsmall,placeholder,iconloader);
+
+                                if (viewport.get_first_row()!=oldfirstrow || oldcount==0 || shown.empty()) {
+                                    staticlayer.rebuild();
+                                    dirty.invalidate_all();
+                                } else {
+                                    // everything before from kept its cell
+                                    int end = viewport.get_first_index()+viewport.get_rows()*viewport.get_cols();
+                                    for (int i=from>viewport.get_first_index() ? from : viewport.get_first_index(); i<end; i++) {
+                                        SDL_Rect rect = viewport.get_cell_rect(i);
+                                        staticlayer.update(rect);
+                                        dirty.add(rect);
+                                    }
+                                }
+                            }
+                            indexsaved = false;
+                        } else {
+                            grid.select(prevselected);
+                        }
+                        // the selection change is already part of the redraw above
+                        prevselected = grid.get_selected();
+                        free_retired(retired);
+                    }
+                    break;
+
+                case SDL_KEYDOWN:
+                    benchkeyhandled = benchkeystart!=0;
+                    switch(event.key.keysym.sym)
                     {
-                        int i = get_selected_apk(apks);
-                        if (i>=0) {
-                            runapk = apks[i]->get_apk_filename();
+                    default:
+                        // typing narrows the grid down to the apks whose name contains the text
+                        if (event.key.keysym.unicode>=' ' && event.key.keysym.unicode<0x7f
+                            && (event.key.keysym.unicode!=' ' || labelindex.is_filtering())) {
+                            labelindex.push(char(event.key.keysym.unicode));
+                            filterchanged = true;
                         }
+                        break;
+                    case SDLK_BACKSPACE:
+                        if (labelindex.is_filtering()) {
+                            labelindex.pop();
+                            filterchanged = true;
+                        }
+                        break;
+                    case SDLK_ESCAPE:
+                        // the first escape only clears the filter
+                        if (labelindex.is_filtering()) {
+                            labelindex.clear_query();
+                            filterchanged = true;
+                        } else {
+                            done = true;
+                        }
+                        break;
+                    case SDLK_LEFT: moveleftright--; break;
+                    case SDLK_RIGHT: moveleftright++; break;
+                    case SDLK_UP: moveupdown--; break;
+                    case SDLK_DOWN: moveupdown++; break;
+    #ifdef PANDORA
+                    case SDLK_HOME:
+                    case SDLK_END:
+                    case SDLK_PAGEUP:
+                    case SDLK_PAGEDOWN:
+    #endif
+                    case SDLK_RETURN:
+                        {
+                            ApkWidget* apk = grid.get_selected_apk();
+                            if (apk) {
+                                runapk = apk->get_apk_filename();
+                            }
+                        }
+                    break;
                     }
-                break;
-                }
-                break;
+                    break;
 
-            case SDL_MOUSEBUTTONDOWN:
-                if (closebutton->pick(event.button.x,event.button.y)) {
-                    done = true;
-                } else {
-                    tmpapk = pick_apk(event.button.x,event.button.y,apks);
-                    if (tmpapk) {
-                        cout << "Selected " << tmpapk->get_apk_filename() << endl;
-                        runapk = tmpapk->get_apk_filename();
+                case SDL_MOUSEBUTTONDOWN:
+                    if (event.button.button==SDL_BUTTON_WHEELUP || event.button.button==SDL_BUTTON_WHEELDOWN) {
+                        scrollrows += event.button.button==SDL_BUTTON_WHEELUP ? -1 : 1;
+                    } else if (closebutton->pick(event.button.x,event.button.y)) {
+                        done = true;
+                    } else {
+                        tmpapk = grid.pick(event.button.x,event.button.y);
+                        if (tmpapk) {
+                            cout << "Selected " << tmpapk->get_apk_filename() << endl;
+                            runapk = tmpapk->get_apk_filename();
+                        }
                     }
+                    break;
+                }
+            }
+            while (!done && runapk.size()==0 && SDL_PollEvent(&event));
+
+            // however much was typed, the grid is laid out once
+            if (filterchanged) {
+                show_matches(apks,labelindex,&shown,grid.get_selected_apk(),&grid,&viewport,fontsmall,placeholder,iconloader);
+                if (filtertext) SDL_FreeSurface(filtertext);
+                filtertext = render_filter(labelindex,fontbig,fontcolor);
+                staticlayer.set_filter(filtertext);
+                animations.stop(&scrollanim);
+                viewport.set_scroll_offset(0);
+                prevfirstrow = viewport.get_first_row();
+                staticlayer.rebuild();
+                dirty.invalidate_all();
+            }
+
+            // only the net movement is applied
+            if (moveleftright || moveupdown) {
+                grid.move(moveleftright,moveupdown);
+            }
+            if (scrollrows) {
+                scrolled = viewport.scroll_by(scrollrows);
+            }
+
+            if (!iconsready && iconloader->get_pending()==0) {
+                Profiler::add_phase("icons_ready",0,Profiler::now());
+                iconsready = true;
+            }
+
+            // icon entries are final once every icon went through the loader
+            if (iconloader->get_pending()==0 && !indexsaved) {
+                if (apkindex.update(apks)) {
+                    apkindex.save(INDEXFILE);
                 }
+                indexsaved = true;
+            }
+
+            // a selection change only touches the old and the new widget, unless it scrolls the grid
+            int selected = grid.get_selected();
+            if (selected>=0 && selected!=prevselected) {
+                scrolled = viewport.ensure_visible(shown[selected]->get_row()) || scrolled;
+            }
+            if (scrolled) {
+                grid.update_viewport(fontsmall,placeholder,iconloader);
+                if (scrollanim.scroll(viewport.get_first_row()-prevfirstrow))
+                    animations.start(&scrollanim);
+                else
+                    animations.stop(&scrollanim);
+                // only the grid moved, top bar, logo and the rest keep their pixels
+                staticlayer.update(viewport.get_rect());
+                dirty.add_band(viewport.get_rect());
+            }
+            if (selected!=prevselected && selectionanim.retarget()) {
+                animations.start(&selectionanim);
+            }
+
+            // input that changed nothing on screen has no latency to measure
+            if (dirty.empty()) {
+                inputtime = 0;
+            }
+        }
+
+        // fixed steps while something moves, the frame cap above paces them
+        if (animations.is_active()) {
+            Uint32 now = SDL_GetTicks();
+            if (animations.update(now)==0 && dirty.empty()) {
+                SDL_Delay(animations.get_time_to_next_step(now));
+            }
+        }
+
+        // resident mode: run apkenv from here and come back to the same grid, no rescan
+        if (resident && runapk.size())
+        {
+            history.record(runapk);
+            if (!history.save(CONFIGFILE)) {
+                cerr << "Failed to save " << CONFIGFILE << endl;
+            }
+            animations.stop(&scrollanim);
+            animations.stop(&selectionanim);
+            viewport.set_scroll_offset(0);
+
+            // leave memory and the display to the game, only widgets, labels and the index stay
+            delete iconloader;
+            grid.release_surfaces();
+            free_retired(retired);
+            delete iconatlas;
+            staticlayer.release();
+            GlyphCache::free_all();
+            ApkWidget::S_HandlePool->flush();
+            ApkWidget::S_CacheWriter->flush();
+            SDL_QuitSubSystem(SDL_INIT_VIDEO);
+
+            cout << "Running " << runapk << endl;
+            launch_apk(APKENV,runapk,APKENVLOG);
+            runapk.clear();
+
+            // background, logo and selection are software surfaces and survive the video restart
+            screen = open_video(icon);
+            if (!screen) {
                 break;
             }
+            iconatlas = new IconAtlas(ICONMAXWIDTH,ICONMAXHEIGHT,ATLASPAGESIZE);
+            iconloader = new IconLoader(scanthreads,iconatlas);
+            grid.update_viewport(fontsmall,placeholder,iconloader);
+            staticlayer.resume(screen);
+            dirty.invalidate_all();
+            // the game most likely pushed the apks out of the page cache
+            prefetched = false;
+
+            // the watcher could not post while the video was down, look for changes made meanwhile
+            SDL_Event rescan;
+            memset(&rescan,0,sizeof(rescan));
+            rescan.type = SDL_USEREVENT;
+            rescan.user.code = EVENT_FOLDERCHANGED;
+            SDL_PushEvent(&rescan);
         }
     }
 
+    // the atlas empties as the widgets go, so it is reported while their icons are still in
+    if (printstats) {
+        iconatlas->print_stats(cout);
+    }
+    Profiler::set_count("atlas_pages",iconatlas->get_page_count());
+    Profiler::set_count("atlas_used_cells",iconatlas->get_used_cells());
+    Profiler::set_count("atlas_bytes",iconatlas->get_bytes());
+
+    delete folderwatcher;
+    delete readahead;
+    delete iconloader;
     delete closebutton;
     SDL_FreeSurface(background);
     SDL_FreeSurface(icon);
     SDL_FreeSurface(logo);
 
+    shown.clear();
     free_apks(apks);
+    free_apks(retired);
+    if (filtertext) SDL_FreeSurface(filtertext);
+    delete iconatlas;
+    SDL_FreeSurface(placeholder);
+    delete ApkWidget::S_CacheWriter;
+    if (printstats) {
+        ApkWidget::S_HandlePool->print_stats(cout);
+        ApkWidget::S_SurfaceCache->print_stats(cout);
+        latency.print_stats(cout);
+    }
+    Profiler::set_count("apk_handle_hits",ApkWidget::S_HandlePool->get_hits());
+    Profiler::set_count("apk_handle_misses",ApkWidget::S_HandlePool->get_misses());
+    ApkWidget::S_SurfaceCache->add_profile_counts();
+    if (!Profiler::write()) {
+        cerr << "Failed to write profile" << endl;
+    }
+    delete ApkWidget::S_HandlePool;
+    delete ApkWidget::S_SurfaceCache;
 
+    GlyphCache::free_all();
     TTF_CloseFont(fontbig);
     TTF_CloseFont(fontsmall);
 
@@ -894,7 +3259,10 @@ int main ( int argc, char** argv )
 
     if (runapk.size())
     {
-        save_config(runapk);
+        history.record(runapk);
+        if (!history.save(CONFIGFILE)) {
+            cerr << "Failed to save " << CONFIGFILE << endl;
+        }
 
         string cmdline = RUNAPK;
         cmdline += " \"" + runapk +"\"";
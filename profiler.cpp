@@ -0,0 +1,170 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "profiler.h"
+#include <stdio.h>
+#include <time.h>
+
+using namespace std;
+
+
+bool Profiler::S_Enabled = false;
+string Profiler::S_Filename;
+Uint64 Profiler::S_Origin = 0;
+SDL_mutex* Profiler::S_Mutex = NULL;
+vector<Profiler::Phase> Profiler::S_Phases;
+map<string,Profiler::Total> Profiler::S_Totals;
+map<string,long long> Profiler::S_Counters;
+map<string,Profiler::Steps> Profiler::S_Apks;
+
+
+void Profiler::enable( const string& filename )
+{
+    // before any worker thread exists, so the statics need no lock here
+    S_Filename = filename;
+    S_Mutex = SDL_CreateMutex();
+    S_Origin = 0;
+    S_Origin = now();
+    S_Enabled = true;
+}
+
+Uint64 Profiler::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return Uint64(ts.tv_sec)*1000000 + ts.tv_nsec/1000 - S_Origin;
+}
+
+void Profiler::add_phase( const char* name, Uint64 start, Uint64 end )
+{
+    if (!S_Enabled) return;
+    Phase phase = {name,start,end-start};
+    SDL_LockMutex(S_Mutex);
+    S_Phases.push_back(phase);
+    SDL_UnlockMutex(S_Mutex);
+}
+
+void Profiler::add_time( const char* step, Uint64 duration, const string* apk )
+{
+    if (!S_Enabled) return;
+    SDL_LockMutex(S_Mutex);
+    Total& total = S_Totals[step];
+    total.duration += duration;
+    total.calls ++;
+    if (apk) {
+        S_Apks[*apk][step] += duration;
+    }
+    SDL_UnlockMutex(S_Mutex);
+}
+
+void Profiler::add_count( const char* counter, long long value )
+{
+    if (!S_Enabled) return;
+    SDL_LockMutex(S_Mutex);
+    S_Counters[counter] += value;
+    SDL_UnlockMutex(S_Mutex);
+}
+
+void Profiler::set_count( const char* counter, long long value )
+{
+    if (!S_Enabled) return;
+    SDL_LockMutex(S_Mutex);
+    S_Counters[counter] = value;
+    SDL_UnlockMutex(S_Mutex);
+}
+
+static void write_json_string( FILE* fp, const string& str )
+{
+    fputc('"',fp);
+    for (size_t i=0; i<str.size(); i++) {
+        unsigned char c = str[i];
+        if (c=='"' || c=='\\')
+            fprintf(fp,"\\%c",c);
+        else if (c<0x20)
+            fprintf(fp,"\\u%04x",c);
+        else
+            fputc(c,fp);
+    }
+    fputc('"',fp);
+}
+
+bool Profiler::write()
+{
+    if (!S_Enabled) return true;
+
+    FILE* fp = fopen(S_Filename.c_str(),"w");
+    if (!fp) {
+        return false;
+    }
+
+    SDL_LockMutex(S_Mutex);
+    fprintf(fp,"{\n  \"version\": 1,\n  \"clock\": \"monotonic\",\n  \"unit\": \"us\",\n");
+
+    fprintf(fp,"  \"phases\": [");
+    for (size_t i=0; i<S_Phases.size(); i++) {
+        fprintf(fp,"%s\n    {\"name\": ",i ? "," : "");
+        write_json_string(fp,S_Phases[i].name);
+        fprintf(fp,", \"start\": %llu, \"duration\": %llu}",
+                (unsigned long long)S_Phases[i].start,(unsigned long long)S_Phases[i].duration);
+    }
+    fprintf(fp,"\n  ],\n");
+
+    fprintf(fp,"  \"totals\": {");
+    for (map<string,Total>::const_iterator it=S_Totals.begin(); it!=S_Totals.end(); ++it) {
+        fprintf(fp,"%s\n    ",it==S_Totals.begin() ? "" : ",");
+        write_json_string(fp,it->first);
+        fprintf(fp,": {\"duration\": %llu, \"calls\": %lld}",(unsigned long long)it->second.duration,it->second.calls);
+    }
+    fprintf(fp,"\n  },\n");
+
+    fprintf(fp,"  \"counters\": {");
+    for (map<string,long long>::const_iterator it=S_Counters.begin(); it!=S_Counters.end(); ++it) {
+        fprintf(fp,"%s\n    ",it==S_Counters.begin() ? "" : ",");
+        write_json_string(fp,it->first);
+        fprintf(fp,": %lld",it->second);
+    }
+    fprintf(fp,"\n  },\n");
+
+    fprintf(fp,"  \"apks\": {");
+    for (map<string,Steps>::const_iterator it=S_Apks.begin(); it!=S_Apks.end(); ++it) {
+        fprintf(fp,"%s\n    ",it==S_Apks.begin() ? "" : ",");
+        write_json_string(fp,it->first);
+        fprintf(fp,": {");
+        for (Steps::const_iterator step=it->second.begin(); step!=it->second.end(); ++step) {
+            fprintf(fp,"%s",step==it->second.begin() ? "" : ", ");
+            write_json_string(fp,step->first);
+            fprintf(fp,": %llu",(unsigned long long)step->second);
+        }
+        fprintf(fp,"}");
+    }
+    fprintf(fp,"\n  }\n}\n");
+    SDL_UnlockMutex(S_Mutex);
+
+    return fclose(fp)==0;
+}
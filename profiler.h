@@ -0,0 +1,118 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <SDL.h>
+#include <string>
+#include <map>
+#include <vector>
+
+
+/// startup instrumentation behind --profile=file. everything is a no-op until enable() was
+/// called, records are thread safe since icons and scans run on the worker pools.
+/// times are microseconds on the monotonic clock, counted from enable()
+class Profiler
+{
+public:
+    static void enable( const std::string& filename );
+    static bool is_enabled() { return S_Enabled; }
+
+    static Uint64 now();
+
+    /// a one-off phase of the startup sequence, kept in the order recorded
+    static void add_phase( const char* name, Uint64 start, Uint64 end );
+
+    /// time spent in a step that runs many times, summed per step and, if apk is given, per apk
+    static void add_time( const char* step, Uint64 duration, const std::string* apk );
+
+    static void add_count( const char* counter, long long value );
+    static void set_count( const char* counter, long long value );
+
+    /// writes the json report, returns false if the file could not be written
+    static bool write();
+
+private:
+    struct Phase
+    {
+        std::string name;
+        Uint64 start;
+        Uint64 duration;
+    };
+    struct Total
+    {
+        Uint64 duration;
+        long long calls;
+    };
+    typedef std::map<std::string,Uint64> Steps;
+
+    static bool S_Enabled;
+    static std::string S_Filename;
+    static Uint64 S_Origin;
+    static SDL_mutex* S_Mutex;
+    static std::vector<Phase> S_Phases;
+    static std::map<std::string,Total> S_Totals;
+    static std::map<std::string,long long> S_Counters;
+    static std::map<std::string,Steps> S_Apks;
+};
+
+/// records the time until the end of the enclosing block
+class ProfileScope
+{
+public:
+    /// phase: one-off startup phase, otherwise a repeated step, optionally per apk
+    ProfileScope( const char* name, bool phase=false, const std::string* apk=NULL ) :
+        m_name(name),
+        m_apk(apk),
+        m_phase(phase),
+        m_start(Profiler::is_enabled() ? Profiler::now() : 0)
+    {
+    }
+
+    ~ProfileScope()
+    {
+        if (!Profiler::is_enabled()) {
+            return;
+        }
+        Uint64 end = Profiler::now();
+        if (m_phase)
+            Profiler::add_phase(m_name,m_start,end);
+        else
+            Profiler::add_time(m_name,end-m_start,m_apk);
+    }
+
+private:
+    const char* m_name;
+    const std::string* m_apk;
+    bool m_phase;
+    Uint64 m_start;
+};
+
+#endif
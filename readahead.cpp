@@ -0,0 +1,109 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "readahead.h"
+#include "profiler.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+
+Readahead::Readahead( long long maxbytes ) :
+    m_max_bytes(maxbytes),
+    m_quit(false)
+{
+    m_mutex = SDL_CreateMutex();
+    m_cond = SDL_CreateCond();
+    m_thread = SDL_CreateThread(thread_main,this);
+}
+
+Readahead::~Readahead()
+{
+    SDL_LockMutex(m_mutex);
+    m_quit = true;
+    m_queue.clear();
+    SDL_CondSignal(m_cond);
+    SDL_UnlockMutex(m_mutex);
+
+    if (m_thread) {
+        SDL_WaitThread(m_thread,NULL);
+    }
+    SDL_DestroyCond(m_cond);
+    SDL_DestroyMutex(m_mutex);
+}
+
+void Readahead::prefetch( const vector<string>& files )
+{
+    SDL_LockMutex(m_mutex);
+    // the queue is worked from the back
+    m_queue.assign(files.rbegin(),files.rend());
+    SDL_CondSignal(m_cond);
+    SDL_UnlockMutex(m_mutex);
+}
+
+void Readahead::read_file( const string& file )
+{
+    ProfileScope profile("readahead",false,&file);
+
+    int fd = open(file.c_str(),O_RDONLY);
+    if (fd<0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd,&st)==0) {
+        long long length = st.st_size<m_max_bytes ? st.st_size : m_max_bytes;
+        // queues the reads and returns, readahead(2) would wait for them
+        if (posix_fadvise(fd,0,length,POSIX_FADV_WILLNEED)==0) {
+            Profiler::add_count("readahead_bytes",length);
+        }
+    }
+    close(fd);
+}
+
+int Readahead::thread_main( void* data )
+{
+    Readahead* readahead = (Readahead*)data;
+
+    SDL_LockMutex(readahead->m_mutex);
+    while (!readahead->m_quit) {
+        if (readahead->m_queue.empty()) {
+            SDL_CondWait(readahead->m_cond,readahead->m_mutex);
+            continue;
+        }
+        string file = readahead->m_queue.back();
+        readahead->m_queue.pop_back();
+        SDL_UnlockMutex(readahead->m_mutex);
+        readahead->read_file(file);
+        SDL_LockMutex(readahead->m_mutex);
+    }
+    SDL_UnlockMutex(readahead->m_mutex);
+    return 0;
+}
@@ -0,0 +1,65 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include <SDL.h>
+#include <string>
+#include <vector>
+
+
+/// pulls files into the page cache on a background thread, so whatever reads them next
+/// finds them in memory instead of waiting for the sd card. the ui thread only hands over names
+class Readahead
+{
+public:
+    /// maxbytes: limit per file, the tail of a huge apk is not worth the cache it would evict
+    Readahead( long long maxbytes );
+
+    /// drops the queue and waits for the file being read
+    virtual ~Readahead();
+
+    /// replaces whatever is still queued, files are read in the given order
+    void prefetch( const std::vector<std::string>& files );
+
+protected:
+    static int thread_main( void* data );
+    void read_file( const std::string& file );
+
+private:
+    std::vector<std::string> m_queue;
+    SDL_Thread* m_thread;
+    SDL_mutex* m_mutex;
+    SDL_cond* m_cond;
+    long long m_max_bytes;
+    bool m_quit;
+};
+
+#endif
@@ -0,0 +1,165 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "scalerbench.h"
+#include "iconscaler.h"
+#include <SDL.h>
+#include <SDL/SDL_rotozoom.h>
+#include <math.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+#define SCALERMAXERROR 2.0   // in 8 bit levels, premultiplied
+#define SCALERTARGET   72
+
+
+static double now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return tv.tv_sec*1000000.0+tv.tv_usec;
+}
+
+/// gradients under a round mask with a soft edge, like most launcher icons
+static SDL_Surface* create_test_icon( int w, int h )
+{
+    SDL_Surface* icon = SDL_CreateRGBSurface(SDL_SWSURFACE,w,h,32,0x000000ff,0x0000ff00,0x00ff0000,0xff000000);
+    if (icon==NULL) {
+        return NULL;
+    }
+    srand(w*31+h);
+    for (int y=0; y<h; y++) {
+        Uint8* p = (Uint8*)icon->pixels+y*icon->pitch;
+        for (int x=0; x<w; x++, p+=4) {
+            float dx = (x-w/2.0f)/w, dy = (y-h/2.0f)/h;
+            float d = sqrtf(dx*dx+dy*dy);
+            p[0] = Uint8(x*255/w);
+            p[1] = Uint8(y*255/h);
+            p[2] = Uint8(rand()&255);
+            p[3] = d<0.4f ? 255 : (d<0.5f ? Uint8((0.5f-d)*2550) : 0);
+        }
+    }
+    return icon;
+}
+
+/// straightforward area average in doubles, premultiplied rgba per target pixel
+static void reference_scale( SDL_Surface* icon, int dw, int dh, vector<double>* out )
+{
+    int sw = icon->w, sh = icon->h;
+    out->assign(dw*dh*4,0);
+    for (int y=0; y<dh; y++) {
+        double y0 = double(y)*sh/dh, y1 = double(y+1)*sh/dh;
+        for (int x=0; x<dw; x++) {
+            double x0 = double(x)*sw/dw, x1 = double(x+1)*sw/dw;
+            double* o = &(*out)[(y*dw+x)*4];
+            double area = 0;
+            for (int sy=int(y0); sy<sh && sy<y1; sy++) {
+                for (int sx=int(x0); sx<sw && sx<x1; sx++) {
+                    double w = (fmin(y1,sy+1)-fmax(y0,sy))*(fmin(x1,sx+1)-fmax(x0,sx));
+                    const Uint8* p = (const Uint8*)icon->pixels+sy*icon->pitch+sx*4;
+                    for (int c=0; c<3; c++) {
+                        o[c] += w*p[c]*p[3]/255.0;
+                    }
+                    o[3] += w*p[3];
+                    area += w;
+                }
+            }
+            for (int c=0; c<4; c++) {
+                o[c] /= area;
+            }
+        }
+    }
+}
+
+/// largest difference to the reference in premultiplied 8 bit levels
+static double max_error( SDL_Surface* icon, SDL_Surface* scaled )
+{
+    vector<double> reference;
+    reference_scale(icon,scaled->w,scaled->h,&reference);
+    double error = 0;
+    for (int y=0; y<scaled->h; y++) {
+        const Uint8* p = (const Uint8*)scaled->pixels+y*scaled->pitch;
+        for (int x=0; x<scaled->w; x++, p+=4) {
+            const double* r = &reference[(y*scaled->w+x)*4];
+            for (int c=0; c<4; c++) {
+                double v = c==3 ? p[3] : p[c]*p[3]/255.0;
+                error = fmax(error,fabs(v-r[c]));
+            }
+        }
+    }
+    return error;
+}
+
+int run_scaler_benchmark( int iterations )
+{
+    // xhdpi, xxhdpi, xxxhdpi, play store size and two odd ones, smaller icons are not scaled
+    static const int sizes[][2] = { {96,96}, {144,144}, {192,192}, {512,512}, {200,100}, {73,72} };
+    int failed = 0;
+
+    cout << "icon scaler, " << iterations << " iterations per size, to fit " << SCALERTARGET << "x" << SCALERTARGET << endl;
+    for (size_t i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+        int w = sizes[i][0], h = sizes[i][1];
+        SDL_Surface* icon = create_test_icon(w,h);
+        if (icon==NULL) {
+            return 1;
+        }
+        SDL_Surface* scaled = scale_icon(icon,SCALERTARGET,SCALERTARGET);
+        if (scaled==NULL) {
+            SDL_FreeSurface(icon);
+            return 1;
+        }
+        double error = max_error(icon,scaled);
+        if (error>SCALERMAXERROR) failed ++;
+
+        double start = now_us();
+        for (int n=0; n<iterations; n++) {
+            SDL_FreeSurface(scale_icon(icon,SCALERTARGET,SCALERTARGET));
+        }
+        double scaletime = (now_us()-start)/iterations;
+
+        // same target size, so both do the same work
+        start = now_us();
+        for (int n=0; n<iterations; n++) {
+            SDL_FreeSurface(zoomSurface(icon,double(scaled->w)/w,double(scaled->h)/h,SMOOTHING_ON));
+        }
+        double zoomtime = (now_us()-start)/iterations;
+
+        cout << "  " << w << "x" << h << " -> " << scaled->w << "x" << scaled->h
+             << "  scale_icon " << scaletime << "us, zoomSurface " << zoomtime << "us"
+             << ", max error " << error << (error>SCALERMAXERROR ? " FAILED" : "") << endl;
+
+        SDL_FreeSurface(scaled);
+        SDL_FreeSurface(icon);
+    }
+    return failed ? 1 : 0;
+}
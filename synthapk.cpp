@@ -0,0 +1,370 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "synthapk.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <zlib.h>
+
+using namespace std;
+
+typedef vector<unsigned char> Bytes;
+
+
+/** little endian writers **/
+
+static void put16( Bytes& out, unsigned int v )
+{
+    out.push_back(v&0xff);
+    out.push_back((v>>8)&0xff);
+}
+
+static void put32( Bytes& out, unsigned int v )
+{
+    put16(out,v&0xffff);
+    put16(out,v>>16);
+}
+
+static void set32( Bytes& out, size_t pos, unsigned int v )
+{
+    out[pos] = v&0xff;
+    out[pos+1] = (v>>8)&0xff;
+    out[pos+2] = (v>>16)&0xff;
+    out[pos+3] = (v>>24)&0xff;
+}
+
+static void put_be32( Bytes& out, unsigned int v )
+{
+    out.push_back((v>>24)&0xff);
+    out.push_back((v>>16)&0xff);
+    out.push_back((v>>8)&0xff);
+    out.push_back(v&0xff);
+}
+
+static void pad4( Bytes& out )
+{
+    while (out.size()&3) out.push_back(0);
+}
+
+
+/** png **/
+
+static void put_png_chunk( Bytes& out, const char* type, const Bytes& data )
+{
+    put_be32(out,data.size());
+    size_t start = out.size();
+    out.insert(out.end(),type,type+4);
+    out.insert(out.end(),data.begin(),data.end());
+    put_be32(out,crc32(0,&out[start],out.size()-start));
+}
+
+/// rgba icon with a seed dependent gradient and frame, deflated like a real one
+static Bytes make_png( int size, unsigned int seed )
+{
+    Bytes raw;
+    unsigned char r = seed*37, g = seed*91, b = seed*53;
+    for (int y=0; y<size; y++) {
+        raw.push_back(0); // filter none
+        for (int x=0; x<size; x++) {
+            bool frame = x<2 || y<2 || x>=size-2 || y>=size-2;
+            raw.push_back(frame ? 255 : (unsigned char)(r+x*2));
+            raw.push_back(frame ? 255 : (unsigned char)(g+y*2));
+            raw.push_back(frame ? 255 : b);
+            raw.push_back(frame || ((x+y)&8) ? 255 : 160);
+        }
+    }
+
+    uLongf packedsize = compressBound(raw.size());
+    Bytes packed(packedsize);
+    compress2(&packed[0],&packedsize,&raw[0],raw.size(),Z_BEST_COMPRESSION);
+    packed.resize(packedsize);
+
+    Bytes png;
+    const unsigned char signature[8] = {0x89,'P','N','G','\r','\n',0x1a,'\n'};
+    png.insert(png.end(),signature,signature+8);
+
+    Bytes header;
+    put_be32(header,size);
+    put_be32(header,size);
+    header.push_back(8);   // bit depth
+    header.push_back(6);   // rgba
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+    put_png_chunk(png,"IHDR",header);
+    put_png_chunk(png,"IDAT",packed);
+    put_png_chunk(png,"IEND",Bytes());
+    return png;
+}
+
+
+/** resources.arsc **/
+
+enum {
+    RES_STRING_POOL_TYPE    = 0x0001,
+    RES_TABLE_TYPE          = 0x0002,
+    RES_TABLE_PACKAGE_TYPE  = 0x0200,
+    RES_TABLE_TYPE_TYPE     = 0x0201,
+    RES_TABLE_TYPE_SPEC_TYPE= 0x0202,
+    RES_UTF8_FLAG           = 1<<8,
+    RES_VALUE_TYPE_STRING   = 0x03,
+    RES_CONFIG_SIZE         = 64,
+    RES_PACKAGE_HEADER_SIZE = 288
+};
+
+/// utf-8 string pool, strings shorter than 128 bytes only
+static void put_string_pool( Bytes& out, const vector<string>& strings )
+{
+    size_t start = out.size();
+    put16(out,RES_STRING_POOL_TYPE);
+    put16(out,28);
+    put32(out,0);                   // size, patched below
+    put32(out,strings.size());
+    put32(out,0);                   // styles
+    put32(out,RES_UTF8_FLAG);
+    put32(out,28+strings.size()*4); // strings start
+    put32(out,0);
+
+    Bytes data;
+    for (size_t i=0; i<strings.size(); i++) {
+        put32(out,data.size());
+        data.push_back(strings[i].size());  // utf-16 length, ascii only
+        data.push_back(strings[i].size());  // utf-8 length
+        data.insert(data.end(),strings[i].begin(),strings[i].end());
+        data.push_back(0);
+    }
+    out.insert(out.end(),data.begin(),data.end());
+    pad4(out);
+    set32(out,start+4,out.size()-start);
+}
+
+static void put_type_spec( Bytes& out, int id, int entries )
+{
+    put16(out,RES_TABLE_TYPE_SPEC_TYPE);
+    put16(out,16);
+    put32(out,16+entries*4);
+    out.push_back(id);
+    out.push_back(0);
+    put16(out,0);
+    put32(out,entries);
+    for (int i=0; i<entries; i++) {
+        put32(out,0x100);   // varies by density
+    }
+}
+
+/// one entry type with a single key, value is an index into the global string pool
+static void put_type( Bytes& out, int id, int density, int key, int value )
+{
+    size_t start = out.size();
+    int headersize = 20+RES_CONFIG_SIZE;
+    put16(out,RES_TABLE_TYPE_TYPE);
+    put16(out,headersize);
+    put32(out,0);           // size, patched below
+    out.push_back(id);
+    out.push_back(0);
+    put16(out,0);
+    put32(out,1);           // entry count
+    put32(out,headersize+4);
+
+    Bytes config(RES_CONFIG_SIZE,0);
+    set32(config,0,RES_CONFIG_SIZE);
+    config[14] = density&0xff;
+    config[15] = density>>8;
+    out.insert(out.end(),config.begin(),config.end());
+
+    put32(out,0);           // entry offset
+    put16(out,8);           // ResTable_entry
+    put16(out,0);
+    put32(out,key);
+    put16(out,8);           // Res_value
+    out.push_back(0);
+    out.push_back(RES_VALUE_TYPE_STRING);
+    put32(out,value);
+
+    set32(out,start+4,out.size()-start);
+}
+
+static Bytes make_arsc( const string& appname, const vector<string>& iconpaths, const int* densities )
+{
+    vector<string> values;
+    values.push_back(appname);
+    values.insert(values.end(),iconpaths.begin(),iconpaths.end());
+
+    vector<string> types;
+    types.push_back("drawable");
+    types.push_back("string");
+    vector<string> keys;
+    keys.push_back("icon");
+    keys.push_back("app_name");
+
+    Bytes out;
+    put16(out,RES_TABLE_TYPE);
+    put16(out,12);
+    put32(out,0);   // size, patched below
+    put32(out,1);   // package count
+    put_string_pool(out,values);
+
+    size_t package = out.size();
+    put16(out,RES_TABLE_PACKAGE_TYPE);
+    put16(out,RES_PACKAGE_HEADER_SIZE);
+    put32(out,0);   // size, patched below
+    put32(out,0x7f);
+    const char* name = "org.apkenv.synthetic";
+    for (int i=0; i<128; i++) {
+        put16(out,i<(int)strlen(name) ? name[i] : 0);
+    }
+    size_t offsets = out.size();
+    put32(out,0);   // type strings
+    put32(out,types.size());
+    put32(out,0);   // key strings
+    put32(out,keys.size());
+    put32(out,0);   // type id offset
+
+    set32(out,offsets,out.size()-package);
+    put_string_pool(out,types);
+    set32(out,offsets+8,out.size()-package);
+    put_string_pool(out,keys);
+
+    put_type_spec(out,1,1);
+    for (size_t i=0; i<iconpaths.size(); i++) {
+        put_type(out,1,densities[i],0,1+i);
+    }
+    put_type_spec(out,2,1);
+    put_type(out,2,0,1,0);
+
+    set32(out,package+4,out.size()-package);
+    set32(out,4,out.size());
+    return out;
+}
+
+
+/** zip **/
+
+struct ZipEntry
+{
+    string name;
+    Bytes data;
+};
+
+/// stored entries only, the pngs are deflated already and resources.arsc is stored in real apks too
+static bool write_zip( const string& filename, const vector<ZipEntry>& entries )
+{
+    Bytes out, directory;
+    for (size_t i=0; i<entries.size(); i++) {
+        const ZipEntry& e = entries[i];
+        unsigned int crc = crc32(0,e.data.empty() ? NULL : &e.data[0],e.data.size());
+        unsigned int offset = out.size();
+
+        put32(out,0x04034b50);
+        put16(out,10);      // version needed
+        put16(out,0);       // flags
+        put16(out,0);       // stored
+        put16(out,0);       // time
+        put16(out,0x21);    // date, 1980-01-01
+        put32(out,crc);
+        put32(out,e.data.size());
+        put32(out,e.data.size());
+        put16(out,e.name.size());
+        put16(out,0);
+        out.insert(out.end(),e.name.begin(),e.name.end());
+        out.insert(out.end(),e.data.begin(),e.data.end());
+
+        put32(directory,0x02014b50);
+        put16(directory,20);    // version made by
+        put16(directory,10);
+        put16(directory,0);
+        put16(directory,0);
+        put16(directory,0);
+        put16(directory,0x21);
+        put32(directory,crc);
+        put32(directory,e.data.size());
+        put32(directory,e.data.size());
+        put16(directory,e.name.size());
+        put16(directory,0);     // extra
+        put16(directory,0);     // comment
+        put16(directory,0);     // disk
+        put16(directory,0);     // internal attributes
+        put32(directory,0);     // external attributes
+        put32(directory,offset);
+        directory.insert(directory.end(),e.name.begin(),e.name.end());
+    }
+
+    unsigned int dirstart = out.size();
+    out.insert(out.end(),directory.begin(),directory.end());
+    put32(out,0x06054b50);
+    put16(out,0);
+    put16(out,0);
+    put16(out,entries.size());
+    put16(out,entries.size());
+    put32(out,directory.size());
+    put32(out,dirstart);
+    put16(out,0);
+
+    FILE* fp = fopen(filename.c_str(),"wb");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fwrite(&out[0],out.size(),1,fp)==1;
+    return fclose(fp)==0 && ok;
+}
+
+
+bool write_synthetic_apk( const string& filename, const string& appname, unsigned int seed )
+{
+    // older apks, the launcher picks the hdpi icon which needs no scaling
+    static const char* folders[] = { "res/drawable", "res/drawable-ldpi", "res/drawable-mdpi", "res/drawable-hdpi" };
+    static const int densities[] = { 0, 120, 160, 240 };
+    static const int sizes[] = { 48, 36, 48, 72 };
+    // newer ones only ship hires icons, the first one is picked and scaled down
+    static const char* hiresfolders[] = { "res/drawable-xxxhdpi", "res/drawable-xxhdpi", "res/drawable-xhdpi" };
+    static const int hiresdensities[] = { 640, 480, 320 };
+    static const int hiressizes[] = { 192, 144, 96 };
+
+    bool hires = seed&1;
+    int count = hires ? 3 : 4;
+
+    vector<ZipEntry> entries;
+
+    vector<string> iconpaths;
+    for (int i=0; i<count; i++) {
+        ZipEntry e;
+        e.name = string(hires ? hiresfolders[i] : folders[i])+"/icon.png";
+        e.data = make_png(hires ? hiressizes[i] : sizes[i],seed);
+        iconpaths.push_back(e.name);
+        entries.push_back(e);
+    }
+
+    ZipEntry arsc;
+    arsc.name = "resources.arsc";
+    arsc.data = make_arsc(appname,iconpaths,hires ? hiresdensities : densities);
+    entries.push_back(arsc);
+
+    return write_zip(filename,entries);
+}
@@ -0,0 +1,140 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "workerpool.h"
+#include <unistd.h>
+
+
+int WorkerPool::cpu_count()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n>0 ? int(n) : 1;
+}
+
+WorkerPool::WorkerPool( int threads ) :
+    m_running(0),
+    m_quit(false)
+{
+    m_mutex = SDL_CreateMutex();
+    m_job_cond = SDL_CreateCond();
+    m_idle_cond = SDL_CreateCond();
+
+    if (threads<=0) {
+        threads = cpu_count();
+    }
+    for (int i=0; i<threads; i++) {
+        SDL_Thread* thread = SDL_CreateThread(thread_main,this);
+        if (thread) {
+            m_threads.push_back(thread);
+        }
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    SDL_LockMutex(m_mutex);
+    m_quit = true;
+    SDL_CondBroadcast(m_job_cond);
+    SDL_UnlockMutex(m_mutex);
+
+    for (int i=0,n=m_threads.size(); i<n; i++) {
+        SDL_WaitThread(m_threads[i],NULL);
+    }
+
+    // jobs that never got picked up
+    for (std::multimap<int,Job*>::iterator it=m_jobs.begin(); it!=m_jobs.end(); ++it) {
+        delete it->second;
+    }
+
+    SDL_DestroyCond(m_idle_cond);
+    SDL_DestroyCond(m_job_cond);
+    SDL_DestroyMutex(m_mutex);
+}
+
+void WorkerPool::add( Job* job, int priority )
+{
+    if (m_threads.empty()) {
+        // no threads could be created, degrade to running inline
+        job->run();
+        delete job;
+        return;
+    }
+
+    SDL_LockMutex(m_mutex);
+    m_jobs.insert(std::make_pair(priority,job));
+    SDL_CondSignal(m_job_cond);
+    SDL_UnlockMutex(m_mutex);
+}
+
+void WorkerPool::wait()
+{
+    SDL_LockMutex(m_mutex);
+    while (!m_jobs.empty() || m_running>0) {
+        SDL_CondWait(m_idle_cond,m_mutex);
+    }
+    SDL_UnlockMutex(m_mutex);
+}
+
+Job* WorkerPool::next_job()
+{
+    Job* job = NULL;
+    SDL_LockMutex(m_mutex);
+    while (!m_quit && m_jobs.empty()) {
+        SDL_CondWait(m_job_cond,m_mutex);
+    }
+    if (!m_quit) {
+        job = m_jobs.begin()->second;
+        m_jobs.erase(m_jobs.begin());
+        m_running ++;
+    }
+    SDL_UnlockMutex(m_mutex);
+    return job;
+}
+
+void WorkerPool::job_done()
+{
+    SDL_LockMutex(m_mutex);
+    m_running --;
+    if (m_running==0 && m_jobs.empty()) {
+        SDL_CondBroadcast(m_idle_cond);
+    }
+    SDL_UnlockMutex(m_mutex);
+}
+
+int WorkerPool::thread_main( void* data )
+{
+    WorkerPool* pool = (WorkerPool*)data;
+    Job* job;
+    while ((job=pool->next_job())!=NULL) {
+        job->run();
+        delete job;
+        pool->job_done();
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * apkenvui
+ * Copyright (c) 2013, crow_riot <crow@riot.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <SDL.h>
+#include <map>
+#include <vector>
+
+
+/// a unit of work handed to the WorkerPool, deleted after run() returns
+class Job
+{
+public:
+    virtual ~Job() {}
+    virtual void run() = 0;
+};
+
+
+/// fixed size pool of SDL threads working off a shared job queue
+class WorkerPool
+{
+public:
+    /// threads<=0 uses one thread per online cpu
+    WorkerPool( int threads );
+    virtual ~WorkerPool();
+
+    /// queue a job, the pool takes ownership; lower priorities are picked up first
+    void add( Job* job, int priority=0 );
+
+    /// block until every queued job has finished
+    void wait();
+
+    static int cpu_count();
+
+protected:
+    static int thread_main( void* data );
+    Job* next_job();
+    void job_done();
+
+private:
+    std::vector<SDL_Thread*> m_threads;
+    std::multimap<int,Job*> m_jobs;
+    SDL_mutex* m_mutex;
+    SDL_cond* m_job_cond;
+    SDL_cond* m_idle_cond;
+    int m_running;
+    bool m_quit;
+};
+
+#endif